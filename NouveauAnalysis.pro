@@ -13,6 +13,9 @@ QMAKE_CXXFLAGS+= -fopenmp
 #QMAKE_CXXFLAGS+= -O3
 QMAKE_LFLAGS +=  -fopenmp
 
+#Store spectra in single rather than double precision, see alignedallocator.h
+#DEFINES += SINGLE_PRECISION_SPECTRA
+
 TEMPLATE = app
 
 SOURCES += main.cpp \
@@ -21,7 +24,28 @@ SOURCES += main.cpp \
     spectrumfilter.cpp \
     plotter.cpp \
     singlespectrum.cpp \
-    physicsfunctions.cpp
+    physicsfunctions.cpp \
+    parsefunctions.cpp \
+    ingestpipeline.cpp \
+    runmanifest.cpp \
+    runwatcher.cpp \
+    spectrumexporter.cpp \
+    spillfile.cpp \
+    spectrumkernels.cpp \
+    spectrumexpression.cpp \
+    spectrumview.cpp \
+    spectrumpyramid.cpp \
+    spectrumstatistics.cpp \
+    spectrumarena.cpp \
+    grandaccumulator.cpp
+
+#Build the Grand Spectrum regression check instead of the analysis, see grandcheck.cpp
+#qmake CONFIG+=grand_check
+grand_check {
+    TARGET = GrandCheck
+    SOURCES -= main.cpp
+    SOURCES += grandcheck.cpp
+}
 
 HEADERS += \
     flatfileinterface.h \
@@ -29,5 +53,21 @@ HEADERS += \
     spectrumfilter.h \
     plotter.h \
     singlespectrum.h \
-    physicsfunctions.h
+    physicsfunctions.h \
+    parsefunctions.h \
+    ingestpipeline.h \
+    runmanifest.h \
+    runwatcher.h \
+    spectrumexporter.h \
+    spillfile.h \
+    alignedallocator.h \
+    spectrumkernels.h \
+    spectrumexpression.h \
+    spectrumview.h \
+    spectrumpyramid.h \
+    spectrumstatistics.h \
+    spectrumarena.h \
+    grandaccumulator.h
 
+DISTFILES += \
+    simulate_run.sh
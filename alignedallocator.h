@@ -0,0 +1,99 @@
+#ifndef ALIGNEDALLOCATOR_H
+#define ALIGNEDALLOCATOR_H
+
+// C System-Headers
+#include <stdlib.h>    //posix_memalign(), free()
+// C++ System headers
+#include <vector>      //vector
+#include <cstddef>     //size_t
+#include <cstdint>     //uint16_t
+#include <new>         //std::bad_alloc
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+//
+
+/*!
+ * \brief Alignment (in bytes) of every PowerList buffer- one cache line, which is
+ * also wide enough for the largest SIMD registers (AVX-512).
+ */
+const size_t power_list_alignment = 64;
+
+/*!
+ * \brief Allocator that hands out memory aligned to Alignment bytes, padded up to a
+ * whole number of Alignment sized blocks.
+ *
+ * Alignment lets SIMD kernels use aligned loads and stores, padding means a buffer never shares
+ * a cache line with another allocation, so threads working on different spectra never contend
+ * for the same cache line.
+ */
+template <typename T, size_t Alignment = power_list_alignment>
+class AlignedAllocator {
+
+  public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() noexcept {}
+
+    template <typename U>
+    AlignedAllocator( const AlignedAllocator<U, Alignment>& ) noexcept {}
+
+    T* allocate( size_t n ) {
+
+        size_t num_bytes = ( ( n*sizeof( T ) + Alignment - 1 )/Alignment )*Alignment;
+        void* memory = nullptr;
+
+        if( posix_memalign( &memory, Alignment, num_bytes ) != 0 ) {
+            throw std::bad_alloc();
+        }
+
+        return static_cast<T*>( memory );
+    }
+
+    void deallocate( T* memory, size_t ) noexcept {
+        free( memory );
+    }
+};
+
+template <typename T, typename U, size_t Alignment>
+bool operator== ( const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>& ) {
+    return true;
+}
+
+template <typename T, typename U, size_t Alignment>
+bool operator!= ( const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>& ) {
+    return false;
+}
+
+/*!
+ * \brief Type power values and uncertainties are stored as.
+ *
+ * Defining SINGLE_PRECISION_SPECTRA (see NouveauAnalysis.pro) stores them as float, halving the
+ * memory and memory bandwidth used by every spectrum. Raw data only has about 7 significant
+ * digits, so little is lost. Arithmetic and accumulations (sums, means, Grand Spectrum weights,
+ * limits) are still carried out in double, only the stored values are rounded.
+ */
+#ifdef SINGLE_PRECISION_SPECTRA
+typedef float spectrum_value;
+#else
+typedef double spectrum_value;
+#endif
+
+/*!
+ * \brief Storage used for power values and uncertainties, see AlignedAllocator.
+ */
+typedef std::vector< spectrum_value, AlignedAllocator<spectrum_value> > PowerList;
+
+/*!
+ * \brief Storage used for power values held as 16 bit fixed point, see LoadPolicy::Quantized.
+ */
+typedef std::vector< uint16_t, AlignedAllocator<uint16_t> > QuantizedList;
+
+#endif // ALIGNEDALLOCATOR_H
@@ -4,9 +4,12 @@
 //C System-Headers
 #include <termios.h>  /* POSIX terminal control definitions */
 #include <sys/ioctl.h>
-#include <fcntl.h>//fopen(),fclose()
-#include <unistd.h>//read(), write()
+#include <fcntl.h>//fopen(),fclose(), posix_fadvise()
+#include <unistd.h>//read(), pread(), write()
 #include <stdio.h>
+#include <sys/stat.h>//fstat()
+#include <sys/mman.h>//madvise()
+#include <string.h>//strnlen()
 
 //C++ System headers
 #include <vector>//vector
@@ -21,37 +24,316 @@
 #include <utility>//std::make_pair
 #include <map>//std::map
 #include <mutex>
+#include <limits>//std::numeric_limits
+#include <exception>//std::exception_ptr
+#include <type_traits>//std::is_same
 
 //Boost Headers
 #include <boost/algorithm/string.hpp>//split() and is_any_of for parsing .csv files
 #include <boost/lexical_cast.hpp>//lexical cast (unsurprisingly)
+#include <boost/iostreams/filtering_stream.hpp>//filtering_istream
+#include <boost/iostreams/filter/gzip.hpp>//gzip_decompressor
+#include <boost/iostreams/filter/bzip2.hpp>//bzip2_decompressor
+#include <boost/iostreams/device/back_inserter.hpp>//back_inserter
+#include <boost/iostreams/copy.hpp>//copy
+#include <boost/iostreams/device/file.hpp>//file_source
 #include <dirent.h>
 
 //Miscellaneous Headers
 #include <omp.h>//OpenMP pragmas
 
-FlatFileReader::FlatFileReader(std::string dir_name, std::string sift_term ) {
+//Project Specific Headers
+#include "parsefunctions.h"
+#include "spectrumexporter.h"
+#include "runmanifest.h"
 
-    std::vector<std::string> file_list = EnumerateFiles(dir_name, sift_term);
+//Data files compressed with gzip or bzip2 are recognised by their extension
+inline bool is_gzip( const std::string& file_name ) {
+    return boost::algorithm::ends_with( file_name, ".gz" );
+}
 
-    std::mutex guard;
+inline bool is_bzip2( const std::string& file_name ) {
+    return boost::algorithm::ends_with( file_name, ".bz2" );
+}
+
+inline bool is_compressed( const std::string& file_name ) {
+    return is_gzip( file_name ) || is_bzip2( file_name );
+}
+
+//Deflate, which gzip uses, never compresses by more than about 1032:1
+const uint64_t max_gzip_ratio = 1032;
+
+//Decompress the entire contents of a .gz or .bz2 file, streaming it from disk so the
+//compressed data is never held in memory as a whole
+std::string Decompress( const std::string& file_name, uint64_t compressed_size, uint64_t size_hint ) {
+
+    boost::iostreams::file_source file( file_name, std::ios_base::binary );
+
+    if ( !file.is_open() ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += ": Could not open file " + file_name;
+        throw std::invalid_argument(err_mesg);
+    }
+
+    boost::iostreams::filtering_istream decompressed;
+
+    if ( is_gzip( file_name ) ) {
+        decompressed.push( boost::iostreams::gzip_decompressor() );
+    } else {
+        decompressed.push( boost::iostreams::bzip2_decompressor() );
+    }
+
+    decompressed.push( file );
+
+    //size_hint comes from the file itself, so never let a corrupt one
+    //reserve more than the compressed data could possibly expand to
+    std::string output;
+    output.reserve( std::min( size_hint, compressed_size*max_gzip_ratio ) );
+
+    try {
+        boost::iostreams::copy( decompressed, boost::iostreams::back_inserter( output ) );
+    } catch ( const std::ios_base::failure& err ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += ": Could not decompress " + file_name + ". Reason: " + err.what();
+        throw std::invalid_argument(err_mesg);
+    }
+
+    return output;
+}
+
+FlatFileReader::FlatFileReader(std::string dir_name, std::string sift_term, ReadMode mode, uint io_depth ) {
+
+    read_mode = mode;
+    Load( EnumerateFiles(dir_name, sift_term), io_depth );
+}
+
+FlatFileReader::FlatFileReader(std::string dir_name, std::string sift_term, double f_min, double f_max, ReadMode mode, uint io_depth ) {
+
+    read_mode = mode;
+
+    RunManifest manifest( dir_name, sift_term, io_depth );
+    Load( manifest.FilesInRange( f_min, f_max ), io_depth );
+}
+
+void FlatFileReader::Load( std::vector<std::string> file_list, uint io_depth ) {
+
+    //Each file has its own slot, so no locking is needed when loading files
+    //in parallel and the order of files is preserved.
+    raw_data_list.resize( file_list.size() );
+    mapped_list.resize( file_list.size() );
 
     //Yes, we are reading from disk in parallel
     //It is important to note if this approach is used on a non-RAID
-    //hard disk there will be a signifigant performance DECREASE.
+    //hard disk there will be a signifigant performance DECREASE, in which
+    //case io_depth should be set to 1.
+    io_depth = std::max( io_depth, 1u );
 
-    #pragma omp parallel for
+    //Exceptions cannot leave a parallel region, so hold on to the first
+    //one and throw it once every thread is done
+    std::exception_ptr load_error;
+    std::mutex guard;
+
+    #pragma omp parallel for num_threads( io_depth ) schedule( dynamic )
     for ( uint i = 0 ; i < file_list.size() ; i ++) {
+        try {
+            //Compressed files cannot be mapped, they are always decompressed into memory
+            if ( read_mode == ReadMode::Cached ) {
+                LoadCached( i, file_list[i] );
+            } else if ( read_mode == ReadMode::MemoryMap && !is_compressed( file_list[i] ) ) {
+                MapFile( i, file_list[i] );
+            } else {
+                raw_data_list[i] = FastRead( file_list[i] );
+            }
+        } catch ( ... ) {
+            std::lock_guard<std::mutex> lock ( guard );
+            if ( !load_error ) {
+                load_error = std::current_exception();
+            }
+        }
+    }
+
+    if ( load_error ) {
+        std::rethrow_exception( load_error );
+    }
+}
+
+void FlatFileReader::MapFile( uint index, std::string file_name ) {
+
+    auto& mapped_file = mapped_list.at(index);
+    mapped_file.open( file_name );
+
+    //let the kernel know that it can start reading ahead
+    void* start = const_cast<char*>( mapped_file.data() );
+    madvise( start, mapped_file.size(), MADV_SEQUENTIAL );
+    madvise( start, mapped_file.size(), MADV_WILLNEED );
+}
+
+bool GetFileStamp( std::string file_name, uint64_t& size, int64_t& mtime ) {
+
+    struct stat file_stat;
+
+    if ( stat( file_name.c_str(), &file_stat ) != 0 ) {
+        return false;
+    }
+
+    size = file_stat.st_size;
+    mtime = static_cast<int64_t>( file_stat.st_mtim.tv_sec )*1000000000 + file_stat.st_mtim.tv_nsec;
+    return true;
+}
+
+//Get the size a cache of available bytes should have according to its header, or zero if the
+//counts in the header could not possibly fit (e.g. a corrupt or truncated cache). Each count is
+//bounded by the bytes left for it before it is multiplied, so this never overflows.
+inline uint64_t cache_size( const SpectrumCacheHeader& cache_header, uint64_t available ) {
+
+    if ( available < sizeof( SpectrumCacheHeader ) ) {
+        return 0;
+    }
 
-        std::lock_guard<std::mutex> lock (guard);
-        raw_data_list.push_back( FastRead( file_list.at(i) ) );
+    uint64_t remaining = available - sizeof( SpectrumCacheHeader );
+
+    if ( cache_header.num_header_entries > remaining/sizeof( SpectrumCacheEntry ) ) {
+        return 0;
     }
+
+    remaining -= cache_header.num_header_entries*sizeof( SpectrumCacheEntry );
+
+    if ( cache_header.num_points > remaining/sizeof( double ) ||
+            cache_header.num_points > std::numeric_limits<uint>::max() ) {
+        return 0;
+    }
+
+    return sizeof( SpectrumCacheHeader ) +
+           cache_header.num_header_entries*sizeof( SpectrumCacheEntry ) +
+           cache_header.num_points*sizeof( double );
+}
+
+//Check that a (memory mapped or loaded) cache is complete and was made from the current version of its data file
+inline bool cache_is_current( boost::string_ref cache, const std::string& file_name ) {
+
+    if ( cache.size() < sizeof( SpectrumCacheHeader ) ) {
+        return false;
+    }
+
+    const auto* cache_header = reinterpret_cast<const SpectrumCacheHeader*>( cache.data() );
+
+    uint64_t source_size;
+    int64_t source_mtime;
+
+    if ( !GetFileStamp( file_name, source_size, source_mtime ) ) {
+        return false;
+    }
+
+    return std::equal( cache_header->magic, cache_header->magic + 8, "TLZCACHE" ) &&
+           cache_header->version == 1 &&
+           cache_header->source_size == source_size &&
+           cache_header->source_mtime == source_mtime &&
+           cache.size() == cache_size( *cache_header, cache.size() );
+}
+
+//Check that a cache exists, can be read and is at least long enough to be mapped (empty files cannot be)
+inline bool cache_is_mappable( const std::string& cache_name ) {
+
+    uint64_t file_size;
+    int64_t file_mtime;
+
+    return access( cache_name.c_str(), R_OK ) == 0 && GetFileStamp( cache_name, file_size, file_mtime ) &&
+           file_size >= sizeof( SpectrumCacheHeader );
+}
+
+bool FlatFileReader::OpenCache( uint index, std::string cache_name, std::string file_name ) {
+
+    if ( !cache_is_mappable( cache_name ) ) {
+        return false;
+    }
+
+    MapFile( index, cache_name );
+
+    const auto& mapped_cache = mapped_list.at(index);
+
+    if ( !cache_is_current( boost::string_ref( mapped_cache.data(), mapped_cache.size() ), file_name ) ) {
+        mapped_list.at(index).close();
+        return false;
+    }
+
+    return true;
+}
+
+void FlatFileReader::LoadCached( uint index, std::string file_name ) {
+
+    std::string cache_name = file_name + spectrum_cache_extension;
+
+    if ( OpenCache( index, cache_name, file_name ) ) {
+        return;
+    }
+
+    //No usable cache, so parse the data file once and write a new one.
+    raw_data_list[index] = FastRead( file_name );
+    FlatFileParser parser( raw_data_list[index] );
+
+    //If the cache cannot be written (e.g. the data directory is read-only)
+    //we simply keep using the plain text data.
+    if ( WriteSpectrumCache( cache_name, parser.GetHeader(), parser.GetPowerList(), file_name ) &&
+            OpenCache( index, cache_name, file_name ) ) {
+        std::string().swap( raw_data_list[index] );
+    }
+}
+
+CachedFile FlatFileReader::CachedRead( std::string file_name ) {
+
+    std::string cache_name = file_name + spectrum_cache_extension;
+    CachedFile cached_file;
+
+    if ( cache_is_mappable( cache_name ) ) {
+        cached_file.cache.open( cache_name );
+
+        if ( cache_is_current( cached_file.view(), file_name ) ) {
+            return cached_file;
+        }
+
+        cached_file.cache.close();
+    }
+
+    //No usable cache, so parse the data file once and write a new one, exactly as LoadCached()
+    //would. What was just parsed is handed back, there is no need to read the new cache.
+    cached_file.parser.reset( new FlatFileParser( FastRead( file_name ) ) );
+
+    const auto& parser = cached_file.parser;
+    WriteSpectrumCache( cache_name, parser->GetHeader(), parser->GetPowerList(), file_name );
+
+    return cached_file;
 }
 
 FlatFileReader::~FlatFileReader() {
     raw_data_list.clear();
+    mapped_list.clear();
+}
+
+
+//Get the numeric index of a data file, i.e. N for a file named "SA_F<N>.csv"
+//and a sift term of "SA_F". Files without an index are placed after all others.
+inline unsigned long file_index( const std::string& file_name, const std::string& sift_term ) {
+
+    auto idx_start = file_name.find( sift_term ) + sift_term.size();
+    auto idx_end = file_name.find_first_not_of( "0123456789", idx_start );
+
+    if( idx_end == idx_start ) {
+        return std::numeric_limits<unsigned long>::max();
+    }
+
+    return std::stoul( file_name.substr( idx_start, idx_end - idx_start ) );
 }
 
+bool FlatFileReader::IsDataFile( const std::string& file_name, const std::string& sift_term ) {
+
+    //binary caches and manifests share the name of their data files, and are written
+    //to temporary files first, so make sure we do not pick any of them up
+    bool is_cache = boost::algorithm::ends_with( file_name, spectrum_cache_extension ) ||
+                    boost::algorithm::ends_with( file_name, run_manifest_extension ) ||
+                    boost::algorithm::ends_with( file_name, ".tmp" );
+
+    return file_name.find( sift_term ) != std::string::npos && !is_cache;
+}
 
 std::vector<std::string> FlatFileReader::EnumerateFiles(std::string dir_name, std::string sift_term) {
 
@@ -59,7 +341,7 @@ std::vector<std::string> FlatFileReader::EnumerateFiles(std::string dir_name, st
     struct dirent *ent;
     const char* c_dir_name = dir_name.c_str();
 
-    std::vector<std::string> file_names;
+    std::vector< std::pair< unsigned long, std::string > > indexed_names;
 
     if ((dir = opendir (c_dir_name)) != NULL) {
 
@@ -67,13 +349,23 @@ std::vector<std::string> FlatFileReader::EnumerateFiles(std::string dir_name, st
 
             std::string file_name = std::string (ent->d_name);
 
-            if( file_name.find(sift_term) != std::string::npos ) {
-                file_names.push_back( dir_name+file_name );
+            if( IsDataFile( file_name, sift_term ) ) {
+                indexed_names.push_back( std::make_pair( file_index( file_name, sift_term ), file_name ) );
             }
         }
 
-        return file_names;
         closedir (dir);
+
+        //sort by index first and name second, so that the order of files is
+        //the same every time a directory is loaded
+        std::sort( indexed_names.begin(), indexed_names.end() );
+
+        std::vector<std::string> file_names;
+        for ( const auto& indexed_name : indexed_names ) {
+            file_names.push_back( dir_name+indexed_name.second );
+        }
+
+        return file_names;
     } else {
         /* could not open directory */
         perror ("");
@@ -86,90 +378,449 @@ std::vector<std::string> FlatFileReader::EnumerateFiles(std::string dir_name, st
 std::string FlatFileReader::FastRead( std::string file_name ) {
     const char* c_file_name = file_name.c_str();
 
-    std::ifstream file_stream(c_file_name);
-    std::stringstream buffer;
-    buffer << file_stream.rdbuf();
+    int fd = open( c_file_name, O_RDONLY );
+    struct stat file_stat;
+
+    if ( fd < 0 || fstat( fd, &file_stat ) != 0 ) {
+        if ( fd >= 0 ) {
+            close( fd );
+        }
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += ": Could not open file " + file_name;
+        throw std::invalid_argument(err_mesg);
+    }
+
+    //Let the kernel know the whole file is about to be read front to back,
+    //so it can read ahead as aggressively as it likes
+    posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+    posix_fadvise( fd, 0, 0, POSIX_FADV_WILLNEED );
+
+    if ( is_compressed( file_name ) ) {
+
+        //gzip stores the size of the uncompressed data ( modulo 2^32 ) in its last four bytes,
+        //which lets us allocate the output in one go
+        uint64_t size_hint = 0;
+        unsigned char size_bytes[4];
+
+        if ( is_gzip( file_name ) && file_stat.st_size >= 4 && pread( fd, size_bytes, 4, file_stat.st_size - 4 ) == 4 ) {
+            size_hint = size_bytes[0] | size_bytes[1] << 8 | size_bytes[2] << 16 | static_cast<uint32_t>( size_bytes[3] ) << 24;
+        }
 
-    return buffer.str();
+        close( fd );
+        return Decompress( file_name, file_stat.st_size, size_hint );
+    }
+
+    //Read straight into a buffer of the correct size, rather than
+    //going through a stream buffer first
+    std::string buffer( file_stat.st_size, '\0' );
+    size_t total_read = 0;
+
+    while ( total_read < buffer.size() ) {
+        ssize_t bytes_read = read( fd, &buffer[total_read], buffer.size() - total_read );
+
+        if ( bytes_read <= 0 ) {
+            break;
+        }
+
+        total_read += bytes_read;
+    }
+
+    close( fd );
+    buffer.resize( total_read );
+
+    return buffer;
+}
+
+std::string FlatFileReader::ReadHeader( std::string file_name ) {
+
+    boost::iostreams::file_source file( file_name, std::ios_base::binary );
+
+    if ( !file.is_open() ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += ": Could not open file " + file_name;
+        throw std::invalid_argument(err_mesg);
+    }
+
+    boost::iostreams::filtering_istream stream;
+
+    if ( is_gzip( file_name ) ) {
+        stream.push( boost::iostreams::gzip_decompressor() );
+    } else if ( is_bzip2( file_name ) ) {
+        stream.push( boost::iostreams::bzip2_decompressor() );
+    }
+
+    stream.push( file );
+
+    //The header is only a few hundred bytes, so a single block is almost always enough
+    std::string header;
+    char block[4096];
+
+    try {
+        while ( stream.read( block, sizeof( block ) ) || stream.gcount() > 0 ) {
+
+            header.append( block, stream.gcount() );
+
+            size_t token = ( header.front() == '@' )? 0 : header.find( "\n@" );
+
+            if ( token != std::string::npos ) {
+                header.resize( ( token == 0 )? 1 : token + 2 );
+                break;
+            }
+        }
+    } catch ( const std::ios_base::failure& err ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += ": Could not read header of " + file_name + ". Reason: " + err.what();
+        throw std::invalid_argument(err_mesg);
+    }
+
+    return header;
 }
 
 uint FlatFileReader::size() {
     return raw_data_list.size();
 }
 
-std::string FlatFileReader::at(uint index) {
-    if( index >= raw_data_list.size() ) {
+void FlatFileReader::CheckIndex(uint index) {
+    if( index >= size() ) {
         std::string err_mesg = "Requested index of ";
         err_mesg += boost::lexical_cast<std::string>(index);
         err_mesg +=" is greater than the number of loaded files ";
-        err_mesg +="("+boost::lexical_cast<std::string>(raw_data_list.size() - 1)+")";
+        err_mesg +="("+boost::lexical_cast<std::string>(size() - 1)+")";
         throw std::out_of_range(err_mesg);
     }
+}
+
+std::string FlatFileReader::at(uint index) {
+    return view(index).to_string();
+}
+
+boost::string_ref FlatFileReader::view(uint index) {
+    CheckIndex(index);
+
+    const auto& mapped_file = mapped_list[index];
+
+    if ( mapped_file.is_open() ) {
+        return boost::string_ref( mapped_file.data(), mapped_file.size() );
+    }
+
+    return boost::string_ref( raw_data_list[index] );
+}
+
+FlatFileParser::FlatFileParser( boost::string_ref raw_data, bool header_only ) {
+    this->header_only = header_only;
+    ParseRawData( raw_data );
+}
+
+FlatFileParser::~FlatFileParser() {}
+
+uint FlatFileParser::NumPoints() {
+    return num_points;
+}
+
+PowerList& FlatFileParser::GetPowerList() {
+    return power_list;
+}
+
+std::map<std::string,double>& FlatFileParser::GetHeader() {
+    return header;
+}
+
+void FlatFileParser::ParseRawData( boost::string_ref raw ) {
+
+    if ( raw.starts_with( boost::string_ref( "TLZCACHE", 8 ) ) ) {
+        ParseCache( raw );
+        return;
+    }
+
+    const char* pos = raw.data();
+    const char* end = raw.data() + raw.size();
+
+    pos = ParseHeader( pos, end );
+
+    if ( header_only ) {
+        //one point per line that is not blank- exactly what decoding would give,
+        //unless a line cannot be decoded at all- and counting is far cheaper
+        num_points = count_lines( pos, end );
+        return;
+    }
+
+    ParsePowerList( pos, end );
+    num_points = power_list.size();
+}
+
+void FlatFileParser::ParseCache( boost::string_ref raw ) {
+
+    //A cache is laid out exactly as it is used, so all there is to do is check
+    //its size and read the header and power values straight out of it.
+    const auto* cache_header = reinterpret_cast<const SpectrumCacheHeader*>( raw.data() );
+
+    if ( raw.size() < sizeof( SpectrumCacheHeader ) ||
+            cache_size( *cache_header, raw.size() ) == 0 || cache_header->version != 1 ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += ": Spectrum cache is truncated, corrupt or has an unknown version.";
+        throw std::invalid_argument(err_mesg);
+    }
+
+    const auto* entries = reinterpret_cast<const SpectrumCacheEntry*>( cache_header + 1 );
+    const auto* power_values = reinterpret_cast<const double*>( entries + cache_header->num_header_entries );
+
+    for ( uint i = 0 ; i < cache_header->num_header_entries ; i ++ ) {
+        const auto& entry = entries[i];
+        header[ std::string( entry.name, strnlen( entry.name, sizeof( entry.name ) ) ) ] = entry.value;
+    }
+
+    num_points = cache_header->num_points;
+
+    //Power values are copied (in a single pass, no parsing) into the spectrum's own aligned list,
+    //which may be single precision and usually outlives the mapping
+    if ( !header_only ) {
+        power_list.assign( power_values, power_values + cache_header->num_points );
+    }
+}
+
+const char* FlatFileParser::ParseHeader( const char* pos, const char* end ) {
+
+    //Header enteries have the form "parameter;value" and are terminated by a
+    //line containing only the token "@"
+    while ( pos < end ) {
+
+        const char* eol = find_line_end( pos, end );
+        const char* delim = find_delimiter( pos, eol, ';' );
+
+        const char* line = pos;
+        pos = eol + 1;
+
+        if ( delim != eol ) {
+            double val;
+
+            if ( !parse_field( delim + 1, eol, val ) ) {
+                std::string err_mesg = __FUNCTION__;
+                err_mesg += ": Could not read header entry '" + std::string( line, eol ) + "'";
+                throw std::invalid_argument(err_mesg);
+            }
+
+            header[ std::string( line, delim ) ] = val;
+
+        } else if ( *line == '@' ) {
+            break;
+        }
+    }
+
+    return pos;
+}
+
+void FlatFileParser::ParsePowerList( const char* pos, const char* end ) {
+
+    if ( pos >= end ) {
+        return;
+    }
+
+    size_t max_chunks = static_cast<size_t>( end - pos )/parallel_parse_chunk;
+    uint num_chunks = static_cast<uint>( std::min( max_chunks, static_cast<size_t>( omp_get_max_threads() ) ) );
+
+    if ( num_chunks > 1 ) {
+        ParsePowerListChunked( pos, end, num_chunks );
+        return;
+    }
+
+    //Estimate the number of points from the length of the first line, rather
+    //than making an extra pass over the data to count lines. Lines only vary in
+    //length by a character or two so a little slack avoids any reallocation.
+    size_t line_length = find_line_end( pos, end ) - pos + 1;
+    size_t estimated_points = ( end - pos )/line_length;
+    power_list.reserve( estimated_points + estimated_points/8 + 16 );
+
+    const char* bad_line = parse_lines( pos, end, power_list );
+
+    if ( bad_line != nullptr ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += ": Could not read power value '" + std::string( bad_line, find_line_end( bad_line, end ) ) + "'";
+        throw std::invalid_argument(err_mesg);
+    }
+}
+
+void FlatFileParser::ParsePowerListChunked( const char* pos, const char* end, uint num_chunks ) {
+
+    //Split into chunks of roughly equal size, each starting just after a newline
+    std::vector<const char*> chunk_start( num_chunks + 1, end );
+    chunk_start[0] = pos;
+
+    for ( uint i = 1 ; i < num_chunks ; i ++ ) {
+        const char* guess = std::max( pos + ( end - pos )*i/num_chunks, chunk_start[i - 1] );
+        const char* line_end = find_line_end( guess, end );
+        chunk_start[i] = ( line_end < end )? line_end + 1 : end;
+    }
+
+    //Every line holds at most one value, so counting lines gives each chunk
+    //its own region of power_list to write into
+    std::vector<size_t> chunk_offset( num_chunks + 1, 0 );
+    std::vector<size_t> chunk_points( num_chunks, 0 );
+    std::vector<const char*> bad_line( num_chunks, nullptr );
+
+    #pragma omp parallel for num_threads( num_chunks )
+    for ( uint i = 0 ; i < num_chunks ; i ++ ) {
+        const char* first = chunk_start[i];
+        const char* last = chunk_start[i + 1];
+        chunk_points[i] = std::count( first, last, '\n' ) + ( first < last && last[-1] != '\n' );
+    }
+
+    for ( uint i = 0 ; i < num_chunks ; i ++ ) {
+        chunk_offset[i + 1] = chunk_offset[i] + chunk_points[i];
+    }
+
+    power_list.resize( chunk_offset[num_chunks] );
+
+    #pragma omp parallel for num_threads( num_chunks )
+    for ( uint i = 0 ; i < num_chunks ; i ++ ) {
+        bad_line[i] = parse_lines( chunk_start[i], chunk_start[i + 1], power_list.data() + chunk_offset[i], chunk_points[i] );
+    }
+
+    for ( uint i = 0 ; i < num_chunks ; i ++ ) {
+        if ( bad_line[i] != nullptr ) {
+            std::string err_mesg = __FUNCTION__;
+            err_mesg += ": Could not read power value '" + std::string( bad_line[i], find_line_end( bad_line[i], end ) ) + "'";
+            throw std::invalid_argument(err_mesg);
+        }
+    }
 
-    return raw_data_list.at(index);
+    //Blank lines leave gaps at the end of a chunk's region, close them up
+    size_t num_values = chunk_points[0];
+    for ( uint i = 1 ; i < num_chunks ; i ++ ) {
+        if ( chunk_offset[i] != num_values ) {
+            std::copy( power_list.begin() + chunk_offset[i],
+                       power_list.begin() + chunk_offset[i] + chunk_points[i],
+                       power_list.begin() + num_values );
+        }
+        num_values += chunk_points[i];
+    }
+
+    power_list.resize( num_values );
+}
+
+bool WriteSpectrumCache( std::string cache_name,
+                         const std::map<std::string, double>& header,
+                         const PowerList& power_list,
+                         std::string source_name ) {
+
+    SpectrumCacheHeader cache_header = {};
+    std::copy_n( "TLZCACHE", 8, cache_header.magic );
+    cache_header.version = 1;
+    cache_header.num_points = power_list.size();
+
+    if ( !source_name.empty() &&
+            !GetFileStamp( source_name, cache_header.source_size, cache_header.source_mtime ) ) {
+        return false;
+    }
+
+    std::vector<SpectrumCacheEntry> entries;
+    for ( const auto& key_val : header ) {
+        SpectrumCacheEntry entry = {};
+
+        if ( key_val.first.size() >= sizeof( entry.name ) ) {
+            std::cout << "Parameter name " << key_val.first << " is too long to be cached." << std::endl;
+            continue;
+        }
+
+        std::copy( key_val.first.begin(), key_val.first.end(), entry.name );
+        entry.value = key_val.second;
+        entries.push_back( entry );
+    }
+    cache_header.num_header_entries = entries.size();
+
+    std::string temp_name = cache_name + ".tmp";
+    FILE* cache_file = std::fopen( temp_name.c_str(), "wb" );
+
+    if ( cache_file == NULL ) {
+        return false;
+    }
+
+    //caches always hold doubles, whatever spectra are stored as
+    std::vector<double> converted;
+    const void* power_values = power_list.data();
+
+    if ( !std::is_same<spectrum_value, double>::value ) {
+        converted.assign( power_list.begin(), power_list.end() );
+        power_values = converted.data();
+    }
+
+    bool written = ( std::fwrite( &cache_header, sizeof( cache_header ), 1, cache_file ) == 1 ) &&
+                   ( std::fwrite( entries.data(), sizeof( SpectrumCacheEntry ), entries.size(), cache_file ) == entries.size() ) &&
+                   ( std::fwrite( power_values, sizeof( double ), power_list.size(), cache_file ) == power_list.size() );
+
+    written = ( std::fclose( cache_file ) == 0 ) && written;
+
+    if ( !written || std::rename( temp_name.c_str(), cache_name.c_str() ) != 0 ) {
+        std::remove( temp_name.c_str() );
+        return false;
+    }
+
+    return true;
 }
 
 FlatFileSaver::FlatFileSaver(std::string dir_name) {
     save_file_path = dir_name;
 }
 
+FlatFileSaver::~FlatFileSaver() {}
+
 template <typename T>
 void FlatFileSaver::load(std::vector<T> vec) {
 
-    for (const auto& val : vec ) {
-        try {
-            std::string num = boost::lexical_cast<std::string>(val);
-            power_list.push_back(num);
-        } catch (const boost::bad_lexical_cast& err) {
-            std::cout << "Could not add element! Reason:" << err.what() << std::endl;
-            return;
-        }
-    }
+    //values are kept as numbers, they are only formatted once when written to disk
+    power_list.insert( power_list.end(), vec.begin(), vec.end() );
 }
 
 template <typename T>
 void FlatFileSaver::load(std::map<std::string, T> header) {
 
     for (const auto& key_val : header ) {
-        try {
-            std::string val = boost::lexical_cast<std::string>(key_val.second);
-            header_map [key_val.first] = val;
-        } catch (const boost::bad_lexical_cast& err) {
-            std::cout << "Could not add element! Reason:" << err.what() << std::endl;
-            return;
-        }
+        header_map [key_val.first] = key_val.second;
     }
 }
 
-std::string FlatFileSaver::cat() {
-    std::string total;
+bool FlatFileSaver::dump( SaveFormat format ) {
 
-    for ( const auto& val : power_list ) {
-        total += val + "\n";
+    if ( power_list.size() <= 1 ) {
+        std::cout << "Nothing to write to disk." << std::endl;
+        return false;
     }
 
-    return total;
-}
+    if ( format == SaveFormat::Cache ) {
+        return dump_cache();
+    }
 
-bool FlatFileSaver::dump() {
-    const char* c_path=save_file_path.c_str();
+    std::ofstream save_file( save_file_path, std::ios::out | std::ios::binary | std::ios::trunc );
 
-    if ( power_list.size() <= 1 ) {
-        std::cout << "Nothing to write to disk." << std::endl;
+    if ( !save_file.is_open() ) {
+        //if file is not opened properly, exit function
+        std::cout<<"Failed to write to file"<<std::endl;
         return false;
     }
-    const char* output = cat().c_str();	//convert from std::string to character array
 
-    FILE* config;
-    config = std::fopen(c_path, "w");//open the text file specified by config_file_name and write data to file
+    SpectrumExporter exporter( save_file, ( format == SaveFormat::Binary )? ExportFormat::Binary : ExportFormat::CSV );
 
-    if (config != NULL) {
-        std::fputs(output, config);
-        std::fclose(config);	//close config file
-        return true;
-    } else {
-        //if config if not opened properly, exit function
+    //one power value per line, or one after another if binary
+    for ( const auto& val : power_list ) {
+        exporter.write( val );
+    }
+
+    if ( !exporter.flush() ) {
         std::cout<<"Failed to write to file"<<std::endl;
         return false;
     }
+
+    return true;
 }
+
+bool FlatFileSaver::dump_cache() {
+
+    if ( !WriteSpectrumCache( save_file_path, header_map, power_list ) ) {
+        std::cout<<"Failed to write to file"<<std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+template void FlatFileSaver::load<double>(std::map<std::string, double> header);
+template void FlatFileSaver::load<double>(std::vector<double> vec);
@@ -11,10 +11,95 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>//std::unique_ptr
+#include <cstdint>//fixed width integers for on-disk formats
 //Boost Headers
-//
+#include <boost/utility/string_ref.hpp>//string_ref, a read-only view into raw data
+#include <boost/iostreams/device/mapped_file.hpp>//mapped_file_source
 //Miscellaneous Headers
 //
+//Project Specific Headers
+#include "alignedallocator.h"
+
+/*!
+ * \brief How a FlatFileReader should bring data files into memory.
+ *
+ * Copy - Each file is read from disk and copied into a std::string.\n
+ * MemoryMap - Each file is mapped read-only into memory, no copies are made and
+ * the contents are only paged in from disk as they are parsed.\n
+ * Cached - Each data file is converted to a binary spectrum cache (see SpectrumCacheHeader)
+ * the first time it is loaded. On later loads the cache is memory mapped instead,
+ * as long as the original data file has not changed.
+ *
+ * Note that compressed data files ( .csv.gz or .csv.bz2 ) cannot be memory mapped,
+ * so in MemoryMap mode they are decompressed into a std::string instead.
+ */
+enum class ReadMode {Copy, MemoryMap, Cached};
+
+/*!
+ * \brief Format FlatFileSaver::dump should write files in.
+ *
+ * Text - Plain text, one power value per line.\n
+ * Cache - Binary spectrum cache, see SpectrumCacheHeader.\n
+ * Binary - Raw power values only, as doubles in the byte order of the machine writing them.
+ */
+enum class SaveFormat {Text, Cache, Binary};
+
+/*!
+ * \brief File name extension given to binary spectrum caches,
+ * i.e. the cache of "SA_F0.csv" is "SA_F0.csv.cache"
+ */
+const std::string spectrum_cache_extension = ".cache";
+
+/*!
+ * \brief File name extension given to run manifests, i.e. the manifest of all
+ * "SA_F*" data files in a directory is "SA_F.manifest", see RunManifest.
+ */
+const std::string run_manifest_extension = ".manifest";
+
+/*!
+ * \brief Smallest amount of power spectrum text (in bytes) FlatFileParser hands to each
+ * thread. Power spectra shorter than twice this are always decoded on a single thread.
+ */
+const size_t parallel_parse_chunk = 1 << 20;
+
+/*!
+ * \brief Layout of the start of a binary spectrum cache file.
+ *
+ * A cache file is laid out as:
+ *
+ * \f{verbatim}{
+ *   SpectrumCacheHeader
+ *   SpectrumCacheEntry x num_header_entries
+ *   double x num_points
+ * \f}
+ *
+ * where each SpectrumCacheEntry holds one "parameter;value" pair from the header of the
+ * original data file, and the doubles are the power values in the units they were saved in.
+ * Every section is 8-byte aligned so, once a cache is memory mapped, the header
+ * and power values can be read in place without any parsing.
+ *
+ * Note that caches are written in the byte order of the machine that made them.
+ */
+struct SpectrumCacheHeader {
+    char magic[8]; // always "TLZCACHE"
+    uint32_t version;
+    uint32_t num_header_entries;
+    uint64_t num_points;
+    uint64_t source_size; // size of the data file the cache was made from (bytes)
+    int64_t source_mtime; // modification time of that data file (ns since epoch)
+    uint64_t reserved[3];
+};
+
+/*!
+ * \brief A single "parameter;value" pair as stored in a binary spectrum cache.
+ */
+struct SpectrumCacheEntry {
+    char name[24]; // null terminated
+    double value;
+};
+
+struct CachedFile;
 
 /*!
  * \brief Object that handles basic file IO operations such as enumerating
@@ -22,10 +107,12 @@
  *
  * Upon initialization a FlatFileReader will search through a choosen directory
  *  pick out data files and load each file into a std::string. It should be noted
- *  that files are loaded from disk -in parallel-. Thus files are loaded into the
- *  classes without regard to ordered. Further parallel file IO will only result
- * in a performance increase on systems equipped with RAID or SSD's. Systems that
- * make use of non-RAID hard disks will see a signifigant performance -decrease-.
+ *  that files are loaded from disk -in parallel-, however each file is always stored
+ *  in order of its numeric index (i.e. "SA_F2.csv" is always found before "SA_F10.csv").
+ *  The number of files read at once is set independently of the number of threads used
+ *  for computation. Parallel file IO will only result in a performance increase
+ *  on systems equipped with RAID or SSD's. Systems that make use of non-RAID hard disks
+ *  should use an io_depth of 1.
  */
 class FlatFileReader {
 
@@ -51,8 +138,46 @@ class FlatFileReader {
      * For example it may be the case that files are saved with names like
      * "SA_F0.csv", "SA_F1.csv" , "SA_F2.csv" etc, so an appropiate sift term
      * would be "SA_F" as this string is common to all data files.
+     *
+     * Data files compressed with gzip or bzip2 (e.g. "SA_F0.csv.gz" or "SA_F0.csv.bz2")
+     * are found in the same way and are decompressed, in parallel, as they are loaded.
+     *
+     * \param mode
+     * Whether files should be copied into strings or memory mapped, see ReadMode.
+     *
+     * \param io_depth
+     * The maximum number of files that will be read from disk at once.
      */
-    FlatFileReader(std::string dir_name, std::string sift_term);
+    FlatFileReader(std::string dir_name, std::string sift_term, ReadMode mode = ReadMode::Copy, uint io_depth = 4);
+
+    /*!
+     * \brief Initialize a new Reader that only loads data files covering part
+     * of the frequency range of a data run.
+     *
+     * Which files overlap the requested range is decided from the run manifest
+     * (see RunManifest) so only the header of each data file is ever read, and
+     * only when the manifest is missing or out of date.
+     *
+     * \param dir_name
+     * File path to the directory containing data collected by Electric Tiger
+     *
+     * \param sift_term
+     * Only files containing sift_term in their names will be loaded.
+     *
+     * \param f_min
+     * Lower end of the frequency window (MHz)
+     *
+     * \param f_max
+     * Upper end of the frequency window (MHz). Any data file with
+     * [ min_freq(), max_freq() ] overlapping [ f_min, f_max ] will be loaded.
+     *
+     * \param mode
+     * Whether files should be copied into strings or memory mapped, see ReadMode.
+     *
+     * \param io_depth
+     * The maximum number of files that will be read from disk at once.
+     */
+    FlatFileReader(std::string dir_name, std::string sift_term, double f_min, double f_max, ReadMode mode = ReadMode::Copy, uint io_depth = 4);
     ~FlatFileReader();
 
     /*!
@@ -68,6 +193,21 @@ class FlatFileReader {
      */
     std::string at(uint index);
 
+    /*!
+     * \brief Return a read-only view of the raw file data at a certain index position.
+     *
+     * Unlike at() no copy of the data is made, the view points directly into
+     * the loaded (or memory mapped) file. As such the view is only valid for as long as
+     * this FlatFileReader is alive.
+     *
+     * \param index
+     * The position of the raw file data. Note that if index > size of class
+     * this function will throw an out of bounds error.
+     * \return
+     * View of the raw data, as it was loaded from the file
+     */
+    boost::string_ref view(uint index);
+
     /*!
      * \brief Similar to std::vector::size(), get the number of data sets currently
      * loaded.
@@ -76,32 +216,207 @@ class FlatFileReader {
      */
     uint size();
 
+    /*!
+     * \brief Find all data files in a directory, without loading them.
+     *
+     * \param dir_name
+     * File path to the directory containing data collected by Electric Tiger
+     *
+     * \param sift_term
+     * Only files containing sift_term in their names are returned, see FlatFileReader::FlatFileReader
+     *
+     * \return
+     * Full path to each data file, ordered by the numeric index of each file.
+     */
+    static std::vector<std::string> EnumerateFiles(std::string dir_name, std::string sift_term);
+
+    /*!
+     * \brief Check whether a file name (without its directory) belongs to a data file.
+     *
+     * True if file_name contains sift_term and is not a binary cache, run manifest
+     * or temporary file.
+     */
+    static bool IsDataFile( const std::string& file_name, const std::string& sift_term );
+
+    /*!
+     * \brief Load the entire contents of a single file into a string.
+     *
+     * Files ending in ".gz" or ".bz2" are decompressed on the fly.
+     *
+     * \throws std::invalid_argument
+     * Thrown if the file could not be opened.
+     */
+    static std::string FastRead( std::string file_name);
+
+    /*!
+     * \brief Load a single data file through its binary spectrum cache, see ReadMode::Cached.
+     *
+     * A current cache is memory mapped, nothing is copied out of it. If the cache is missing or
+     * out of date the data file is parsed once and a new cache is written (unless e.g. the data
+     * directory is read-only), and the parsed data file is returned rather than reading back
+     * the new cache, see CachedFile.
+     *
+     * \throws std::invalid_argument
+     * Thrown if the data file could not be opened or parsed.
+     */
+    static CachedFile CachedRead( std::string file_name );
+
+    /*!
+     * \brief Load only the header of a single data file, that is everything up
+     * to and including the "@" token.
+     *
+     * Files are read (or decompressed) a small block at a time, so the power spectrum
+     * that follows the header is never read from disk.
+     *
+     * \throws std::invalid_argument
+     * Thrown if the file could not be opened or decompressed.
+     */
+    static std::string ReadHeader( std::string file_name );
+
   private:
+    ReadMode read_mode;
+
     std::vector<std::string> raw_data_list;
+    std::vector<boost::iostreams::mapped_file_source> mapped_list;
 
-    std::vector<std::string> EnumerateFiles(std::string dir_name, std::string sift_term);
-    uint GetFileLines(std:: string file_name);
+    void Load(std::vector<std::string> file_list, uint io_depth);
+    void CheckIndex(uint index);
+    void MapFile(uint index, std::string file_name);
+    void LoadCached(uint index, std::string file_name);
+    bool OpenCache(uint index, std::string cache_name, std::string file_name);
 
-    std::string FastRead( std::string file_name);
+    uint GetFileLines(std:: string file_name);
 
 };
 
-class FlatFileParser : public FlatFileReader {
+/*!
+ * \brief Object that splits the raw contents of a data file into its header
+ * and power spectrum.
+ *
+ * Parsing is done directly on a read-only view of the data, so the contents
+ * of a file (or a memory mapped file) never need to be copied before parsing.
+ * See SingleSpectrum::SingleSpectrum for a description of the data file format.
+ *
+ * Very long power spectra (e.g. from long FFTs) are split into line aligned chunks of at
+ * least parallel_parse_chunk bytes, which are decoded on separate OpenMP threads straight
+ * into their place in the power list. When a parser is created inside another parallel
+ * region (e.g. by FlatFileReader) the usual OpenMP rules for nested parallelism apply.
+ */
+class FlatFileParser {
 
   public:
-    FlatFileParser( std::string raw_data );
+    /*!
+     * \brief Parse the entire contents of a data file.
+     *
+     * \param raw_data
+     * View of the -entire- contents of a data file.
+     *
+     * \param header_only
+     * If true only the header is decoded, the power values are counted but
+     * GetPowerList() will return an empty list.
+     */
+    FlatFileParser( boost::string_ref raw_data, bool header_only = false );
     ~FlatFileParser();
 
-    std::vector<double> GetPowerList();
-    std::map<std::string,double> GetHeader();
+    /*!
+     * \brief Get the number of power values in the data file, whether or not
+     * they have been decoded.
+     *
+     * When only the header is decoded this is found by counting the lines that are not
+     * blank, which is the number of values decoding gives for any data file that decodes.
+     */
+    uint NumPoints();
+
+    /*!
+     * \brief Get the power values found after the header token, in the units
+     * they were saved (usually dBm).
+     *
+     * A reference is returned so that callers may take ownership of the list
+     * with PowerList::swap rather than copying it.
+     */
+    PowerList& GetPowerList();
+
+    /*!
+     * \brief Get all "parameter;value" pairs found in the header.
+     */
+    std::map<std::string,double>& GetHeader();
 
   private:
 
-    void ParseRawData(std::string raw);
-    uint NumLines(std:: string raw_data);
+    void ParseRawData(boost::string_ref raw);
+    void ParseCache(boost::string_ref raw);
+    const char* ParseHeader(const char* pos, const char* end);
+    void ParsePowerList(const char* pos, const char* end);
+    void ParsePowerListChunked(const char* pos, const char* end, uint num_chunks);
+
+    bool header_only;
+    uint num_points = 0;
+
+    PowerList power_list;
+    std::map<std::string,double> header;
 
 };
 
+/*!
+ * \brief A data file loaded by FlatFileReader::CachedRead().
+ *
+ * Either cache holds its memory mapped binary spectrum cache, or (if there was no usable
+ * cache) parser holds the data file already parsed, which SingleSpectrum can take the
+ * header and power values from without decoding anything again.
+ */
+struct CachedFile {
+    boost::iostreams::mapped_file_source cache;
+    std::unique_ptr<FlatFileParser> parser;
+
+    /*!
+     * \brief Get a view of the mapped cache, valid for as long as cache is open.
+     */
+    boost::string_ref view() const {
+        return boost::string_ref( cache.data(), cache.size() );
+    }
+};
+
+/*!
+ * \brief Get the size and modification time of a file, used to tell whether
+ * caches and manifests made from a data file are still up to date.
+ *
+ * \param size
+ * Set to the size of the file (bytes)
+ *
+ * \param mtime
+ * Set to the modification time of the file (ns since epoch)
+ *
+ * \return
+ * false if the file does not exist.
+ */
+bool GetFileStamp( std::string file_name, uint64_t& size, int64_t& mtime );
+
+/*!
+ * \brief Write a binary spectrum cache to disk, see SpectrumCacheHeader.
+ *
+ * The cache is first written to a temporary file and then renamed, so a partially
+ * written cache is never picked up by a FlatFileReader.
+ *
+ * \param cache_name
+ * Path of the cache file to be written.
+ *
+ * \param header
+ * "parameter;value" pairs to be stored. Parameter names longer than 23 characters are skipped.
+ *
+ * \param power_list
+ * Power values to be stored.
+ *
+ * \param source_name
+ * Path of the data file the cache was made from, or an empty string if there is no such file.
+ *
+ * \return
+ * true if the cache was written successfully.
+ */
+bool WriteSpectrumCache( std::string cache_name,
+                         const std::map<std::string, double>& header,
+                         const PowerList& power_list,
+                         std::string source_name = "" );
+
 class FlatFileSaver {
 
   public:
@@ -114,16 +429,25 @@ class FlatFileSaver {
     template <typename T>
     void load(std::vector<T> vec);
 
-    bool dump();
+    /*!
+     * \brief Write all loaded values to disk.
+     *
+     * \param format
+     * Either plain text or a binary spectrum cache, see SaveFormat.
+     *
+     * \return
+     * true if the file was written successfully.
+     */
+    bool dump( SaveFormat format = SaveFormat::Text );
 
 private:
 
-    std::string cat();
+    bool dump_cache();
 
     std::string save_file_path;
 
-    std::map<std::string, std::string> header_map;
-    std::vector<std::string> power_list;
+    std::map<std::string, double> header_map;
+    PowerList power_list;
 };
 
 #endif // FLATFILEINTERFACE_H
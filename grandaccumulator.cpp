@@ -0,0 +1,626 @@
+// Header for this file
+#include "grandaccumulator.h"
+// C System-Headers
+//
+// C++ System headers
+#include <string>      //string
+#include <stdexcept>   //std::invalid_argument
+#include <cmath>       //sqrt, ceil
+#include <algorithm>   //std::sort, std::min, std::max, std::upper_bound, std::copy, std::find_if
+#include <utility>     //std::move
+#include <limits>      //std::numeric_limits
+// Boost Headers
+//
+// Miscellaneous Headers
+#include <omp.h>  //OpenMP pragmas
+//Project Specific Headers
+#include "spectrum.h"
+#include "singlespectrum.h"
+#include "physicsfunctions.h"
+
+//Ranges of bins at least this long are updated by several threads
+const uint parallel_accumulate_bins = 1 << 14;
+
+GrandRun::GrandRun( double min_freq, double max_freq, uint num_bins, uint grid_offset ) :
+    min_freq( min_freq ),
+    max_freq( max_freq ),
+    //same arithmetic as SingleSpectrum( num_bins, min_freq, max_freq )
+    center_frequency( ( max_freq - min_freq )/2.0 + min_freq ),
+    frequency_span( max_freq - min_freq ),
+    num_bins( num_bins ),
+    grid_offset( grid_offset ),
+    first_bin( 0 ) {}
+
+inline bool below( double bin_frequency, double frequency, bool inclusive ) {
+    return inclusive? ( bin_frequency < frequency ) : ( bin_frequency <= frequency );
+}
+
+uint GrandRun::first_bin_from( double frequency, bool inclusive ) const {
+
+    double bin_width = frequency_span/static_cast<double>( num_bins );
+    double estimate = std::ceil( ( frequency - ( center_frequency - 0.5*frequency_span ) )/bin_width - 0.5 );
+    uint i = static_cast<uint>( std::min( std::max( estimate, 0.0 ), static_cast<double>( num_bins ) ) );
+
+    //the estimate is only off by rounding, so these loops run at most a step or two
+    while( i > 0 && !below( mid_freq( i - 1 ), frequency, inclusive ) ) {
+        i--;
+    }
+
+    while( i < num_bins && below( mid_freq( i ), frequency, inclusive ) ) {
+        i++;
+    }
+
+    return i;
+}
+
+GrandAccumulator::GrandAccumulator() :
+    min_frequency( 0.0 ),
+    max_frequency( 0.0 ),
+    grid_bins( 0 ),
+    lattice_origin( 0.0 ),
+    bin_width( 0.0 ),
+    grid_start( 0 ),
+    spacing( GridSpacing::Combined ),
+    sparse( false ),
+    num_bins( 0 ),
+    spectrum_units( Units::AxionPower ) {}
+
+GrandAccumulator::GrandAccumulator( double min_freq, double max_freq, uint num_bins, const SingleSpectrum& prototype ) :
+    GrandAccumulator( std::vector<GrandRun>( 1, GrandRun( min_freq, max_freq, num_bins, 0 ) ),
+                      min_freq, ( max_freq - min_freq )/static_cast<double>( num_bins ), num_bins,
+                      GrandGrid { GridSpacing::Combined, false, 0.0 }, prototype ) {
+
+    //exactly as given, rather than rebuilt from the bin width
+    max_frequency = max_freq;
+}
+
+GrandAccumulator::GrandAccumulator( std::vector<GrandRun> runs, double min_freq, double bin_width, uint grid_bins,
+                                    const GrandGrid& grid, const SingleSpectrum& prototype ) :
+    min_frequency( min_freq ),
+    max_frequency( min_freq + static_cast<double>( grid_bins )*bin_width ),
+    grid_bins( grid_bins ),
+    lattice_origin( min_freq ),
+    bin_width( bin_width ),
+    grid_start( 0 ),
+    spacing( grid.spacing ),
+    sparse( grid.sparse ),
+    grand_runs( std::move( runs ) ),
+    num_bins( 0 ),
+    spectrum_units( prototype.current_units ) {
+
+    for( auto& run : grand_runs ) {
+        run.first_bin = num_bins;
+        num_bins += run.num_bins;
+    }
+
+    weighted_power.assign( num_bins, 0.0 );
+    total_weight.assign( num_bins, 0.0 );
+    num_covering.assign( num_bins, 0 );
+    grand_power.assign( num_bins, 0.0 );
+    grand_uncertainty.assign( num_bins, 0.0 );
+    limit_power.assign( num_bins, 0.0 );
+    limit_coupling.assign( num_bins, 0.0 );
+
+    dirty_regions.push_back( std::make_pair( 0u, num_bins ) );
+}
+
+GrandAccumulator GrandAccumulator::Plan( const std::vector<SingleSpectrum>& spectra, const GrandGrid& grid ) {
+
+    if( spectra.empty() ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nCannot build a Grand Spectrum- no spectra loaded.";
+        throw std::invalid_argument(err_mesg);
+    }
+
+    uint total_bins = 0;
+    double min_frequency = spectra.front().min_freq();
+    double max_frequency = spectra.front().max_freq();
+    double finest_width = 0.0;
+
+    for( const auto& spec : spectra ) {
+        total_bins += spec.size();
+        min_frequency = std::min( min_frequency, spec.min_freq() );
+        max_frequency = std::max( max_frequency, spec.max_freq() );
+
+        if( spec.size() > 0 && ( finest_width == 0.0 || spec.bin_width() < finest_width ) ) {
+            finest_width = spec.bin_width();
+        }
+    }
+
+    if( total_bins == 0 || ( grid.spacing == GridSpacing::Combined && !grid.sparse ) ) {
+        return GrandAccumulator( min_frequency, max_frequency, total_bins, spectra.front() );
+    }
+
+    double bin_width = grid.bin_width;
+
+    if( grid.spacing == GridSpacing::Combined ) {
+        bin_width = ( max_frequency - min_frequency )/static_cast<double>( total_bins );
+    } else if( grid.spacing == GridSpacing::Finest ) {
+        bin_width = finest_width;
+    }
+
+    if( !( bin_width > 0.0 ) ||
+            ( max_frequency - min_frequency )/bin_width >= static_cast<double>( std::numeric_limits<uint>::max() - 1 ) ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nGrand bins must have a positive width, and not be so narrow that they cannot be counted.";
+        throw std::invalid_argument(err_mesg);
+    }
+
+    auto lattice_freq = [&]( uint j ) {
+        return min_frequency + static_cast<double>( j )*bin_width;
+    };
+
+    //lattice bins [first, last) spanned by each spectrum
+    std::vector< std::pair<uint, uint> > spans;
+
+    for( const auto& spec : spectra ) {
+
+        if( spec.size() == 0 ) {
+            continue;
+        }
+
+        uint first = static_cast<uint>( std::floor( ( spec.min_freq() - min_frequency )/bin_width ) );
+        uint last = static_cast<uint>( std::ceil( ( spec.max_freq() - min_frequency )/bin_width ) );
+
+        //rounding may leave the spectrum a hair outside of its lattice bins
+        while( first > 0 && lattice_freq( first ) > spec.min_freq() ) {
+            first--;
+        }
+
+        while( lattice_freq( last ) < spec.max_freq() ) {
+            last++;
+        }
+
+        spans.push_back( std::make_pair( first, std::max( last, first + 1 ) ) );
+    }
+
+    std::sort( spans.begin(), spans.end() );
+
+    //a dense grid is a single run over the whole lattice, a sparse one a run per stretch of
+    //overlapping (or touching) spectra
+    std::vector< std::pair<uint, uint> > merged;
+
+    for( const auto& span : spans ) {
+        if( !merged.empty() && ( !grid.sparse || span.first <= merged.back().second ) ) {
+            merged.back().second = std::max( merged.back().second, span.second );
+        } else {
+            merged.push_back( span );
+        }
+    }
+
+    std::vector<GrandRun> runs;
+
+    for( const auto& span : merged ) {
+        runs.push_back( GrandRun( lattice_freq( span.first ), lattice_freq( span.second ),
+                                  span.second - span.first, span.first ) );
+    }
+
+    uint lattice_bins = merged.back().second;
+
+    return GrandAccumulator( std::move( runs ), min_frequency, bin_width, lattice_bins, grid, spectra.front() );
+}
+
+uint GrandAccumulator::size() const {
+    return num_bins;
+}
+
+uint GrandAccumulator::grid_size() const {
+    return grid_bins;
+}
+
+const std::vector<GrandRun>& GrandAccumulator::runs() const {
+    return grand_runs;
+}
+
+const GrandRun& GrandAccumulator::run_of( uint i ) const {
+
+    auto run = std::upper_bound( grand_runs.begin(), grand_runs.end(), i,
+                                 []( uint bin, const GrandRun& r ) { return bin < r.first_bin; } );
+
+    return ( run == grand_runs.begin() )? *run : *( run - 1 );
+}
+
+const GrandRun& GrandAccumulator::run_at( double frequency ) const {
+
+    auto run = std::upper_bound( grand_runs.begin(), grand_runs.end(), frequency,
+                                 []( double freq, const GrandRun& r ) { return freq < r.min_freq; } );
+
+    return ( run == grand_runs.begin() )? *run : *( run - 1 );
+}
+
+double GrandAccumulator::mid_freq( uint i ) const {
+
+    const GrandRun& run = run_of( i );
+    return run.mid_freq( i - run.first_bin );
+}
+
+std::pair<uint, uint> GrandAccumulator::covered_bins( double min_freq, double max_freq ) const {
+
+    const GrandRun& run = run_at( min_freq );
+
+    return std::make_pair( run.first_bin + run.first_bin_from( min_freq, true ),
+                           run.first_bin + run.first_bin_from( max_freq, false ) );
+}
+
+GrandSource GrandAccumulator::Source( const SingleSpectrum& spec ) {
+
+    spec.Materialize();
+
+    if( spec.uncertainties.size() != spec.size() ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nUncertainties of spectrum have not been populated.";
+        throw std::invalid_argument(err_mesg);
+    }
+
+    return GrandSource { spec.center_frequency - spec.frequency_span/2.0,
+                         spec.frequency_span,
+                         static_cast<double>( spec.size() ),
+                         spec.sa_power_list.data(),
+                         spec.uncertainties.data() };
+}
+
+bool GrandAccumulator::Accepts( const SingleSpectrum& spec ) const {
+
+    spec.Materialize();
+
+    if( num_bins == 0 || spec.current_units != spectrum_units || spec.uncertainties.size() != spec.size() ) {
+        return false;
+    }
+
+    //the grid may have to grow to fit spec, so make sure its bins can still be counted
+    double grown_span = std::max( max_frequency, spec.max_freq() ) - std::min( min_frequency, spec.min_freq() );
+
+    return bin_width > 0.0 && grown_span/bin_width < static_cast<double>( std::numeric_limits<uint>::max() - 2 );
+}
+
+bool GrandAccumulator::Covers( const SingleSpectrum& spec ) const {
+
+    if( num_bins == 0 ) {
+        return false;
+    }
+
+    const GrandRun& run = run_at( spec.min_freq() );
+
+    return spec.min_freq() >= run.min_freq && spec.max_freq() <= run.max_freq;
+}
+
+bool GrandAccumulator::ChangesLayout( const SingleSpectrum& spec, bool adding ) const {
+
+    if( adding && spec.min_freq() < min_frequency ) {
+        return true;
+    }
+
+    switch( spacing ) {
+    case GridSpacing::Combined:
+        return true;
+    case GridSpacing::Finest:
+        return adding? ( spec.bin_width() < bin_width ) : ( spec.bin_width() <= bin_width );
+    default:
+        return false;
+    }
+}
+
+//A stretch of length bins moving from bin from to bin to, see move_bins()
+struct BinMove {
+    uint from;
+    uint to;
+    uint length;
+};
+
+//Lay the values of every bin out again in a list of new_size bins, bins that are not moved are zero
+template <typename T>
+void move_bins( std::vector<T>& values, const std::vector<BinMove>& moves, uint new_size ) {
+
+    std::vector<T> moved( new_size, T() );
+
+    for( const auto& move : moves ) {
+        std::copy( values.begin() + move.from, values.begin() + move.from + move.length, moved.begin() + move.to );
+    }
+
+    values.swap( moved );
+}
+
+void GrandAccumulator::Extend( double min_freq, double max_freq ) {
+
+    auto lattice_freq = [&]( long j ) {
+        return lattice_origin + static_cast<double>( j )*bin_width;
+    };
+
+    //lattice bins [first, last) spanned by the new spectrum, found exactly as in Plan()
+    long first = static_cast<long>( std::floor( ( min_freq - lattice_origin )/bin_width ) );
+    long last = static_cast<long>( std::ceil( ( max_freq - lattice_origin )/bin_width ) );
+
+    while( lattice_freq( first ) > min_freq ) {
+        first--;
+    }
+
+    while( lattice_freq( last ) < max_freq ) {
+        last++;
+    }
+
+    last = std::max( last, first + 1 );
+
+    //every run touching the new span (or, for a dense grid, every run) is merged with it
+    auto run_start = [&]( const GrandRun& run ) {
+        return grid_start + static_cast<long>( run.grid_offset );
+    };
+
+    auto merge_begin = grand_runs.begin();
+    auto merge_end = grand_runs.end();
+
+    if( sparse ) {
+        merge_begin = std::find_if( grand_runs.begin(), grand_runs.end(), [&]( const GrandRun& run ) {
+            return run_start( run ) + static_cast<long>( run.num_bins ) >= first;
+        } );
+        merge_end = std::find_if( merge_begin, grand_runs.end(), [&]( const GrandRun& run ) {
+            return run_start( run ) > last;
+        } );
+    }
+
+    for( auto run = merge_begin; run != merge_end; run++ ) {
+        first = std::min( first, run_start( *run ) );
+        last = std::max( last, run_start( *run ) + static_cast<long>( run->num_bins ) );
+    }
+
+    //the caches are moved along with the sums, so bring them up to date first
+    Refresh();
+
+    long new_start = std::min( grid_start, first );
+    long new_end = std::max( grid_start + static_cast<long>( grid_bins ), last );
+
+    std::vector<GrandRun> runs;
+    std::vector<BinMove> moves;
+    uint new_bins = 0;
+
+    auto keep = [&]( const GrandRun& run ) {
+        moves.push_back( BinMove { run.first_bin, new_bins, run.num_bins } );
+
+        runs.push_back( run );
+        runs.back().grid_offset = static_cast<uint>( run_start( run ) - new_start );
+        runs.back().first_bin = new_bins;
+        new_bins += run.num_bins;
+    };
+
+    std::for_each( grand_runs.begin(), merge_begin, keep );
+
+    GrandRun merged( lattice_freq( first ), lattice_freq( last ), static_cast<uint>( last - first ),
+                     static_cast<uint>( first - new_start ) );
+    merged.first_bin = new_bins;
+
+    for( auto run = merge_begin; run != merge_end; run++ ) {
+        moves.push_back( BinMove { run->first_bin, merged.first_bin + static_cast<uint>( run_start( *run ) - first ), run->num_bins } );
+    }
+
+    runs.push_back( merged );
+    new_bins += merged.num_bins;
+
+    std::for_each( merge_end, grand_runs.end(), keep );
+
+    move_bins( weighted_power, moves, new_bins );
+    move_bins( total_weight, moves, new_bins );
+    move_bins( num_covering, moves, new_bins );
+    move_bins( grand_power, moves, new_bins );
+    move_bins( grand_uncertainty, moves, new_bins );
+    move_bins( limit_power, moves, new_bins );
+    move_bins( limit_coupling, moves, new_bins );
+
+    grand_runs.swap( runs );
+    num_bins = new_bins;
+
+    if( new_start < grid_start ) {
+        min_frequency = lattice_freq( new_start );
+    }
+    if( new_end > grid_start + static_cast<long>( grid_bins ) ) {
+        max_frequency = lattice_freq( new_end );
+    }
+
+    grid_start = new_start;
+    grid_bins = static_cast<uint>( new_end - new_start );
+
+    //the merged run has new bins, and its old ones have new mid frequencies
+    dirty_regions.push_back( std::make_pair( merged.first_bin, merged.first_bin + merged.num_bins ) );
+}
+
+void GrandAccumulator::Add( const SingleSpectrum& spec ) {
+    Accumulate( spec, 1.0 );
+}
+
+void GrandAccumulator::Remove( const SingleSpectrum& spec ) {
+    Accumulate( spec, -1.0 );
+}
+
+void GrandAccumulator::Accumulate( const SingleSpectrum& spec, double sign ) {
+
+    if( !Accepts( spec ) ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nSpectrum does not fit this Grand Spectrum, see GrandAccumulator::Accepts().";
+        throw std::invalid_argument(err_mesg);
+    }
+
+    if( spec.size() == 0 ) {
+        return;
+    }
+
+    if( !Covers( spec ) ) {
+        if( sign < 0.0 ) {
+            std::string err_mesg = __FUNCTION__;
+            err_mesg += "\nSpectrum lies outside of this Grand Spectrum, so it cannot have been added.";
+            throw std::invalid_argument(err_mesg);
+        }
+
+        Extend( spec.min_freq(), spec.max_freq() );
+    }
+
+    const GrandSource source = Source( spec );
+
+    const GrandRun& run = run_at( spec.min_freq() );
+    const uint first_bin = run.first_bin + run.first_bin_from( spec.min_freq(), true );
+    const uint last_bin = run.first_bin + run.first_bin_from( spec.max_freq(), false );
+
+    #pragma omp parallel for if( last_bin - first_bin >= parallel_accumulate_bins )
+    for( uint i = first_bin; i < last_bin; i++ ) {
+
+        uint bin = source.bin( run.mid_freq( i - run.first_bin ) );
+        double weight = inverse_variance( source.uncertainty[bin] );
+
+        if( sign > 0.0 ) {
+            num_covering[i]++;
+        } else if( num_covering[i] > 0 ) {
+            num_covering[i]--;
+        }
+
+        if( num_covering[i] == 0 ) {
+            //no spectra left, so clear whatever rounding error is left behind
+            weighted_power[i] = 0.0;
+            total_weight[i] = 0.0;
+        } else {
+            weighted_power[i] += sign*weight*source.power[bin];
+            total_weight[i] += sign*weight;
+        }
+    }
+
+    dirty_regions.push_back( std::make_pair( first_bin, last_bin ) );
+}
+
+void GrandAccumulator::Refresh() {
+
+    std::sort( dirty_regions.begin(), dirty_regions.end() );
+
+    uint done_until = 0;
+
+    for( const auto& region : dirty_regions ) {
+
+        //overlapping regions are only recomputed once
+        uint region_start = std::max( region.first, done_until );
+        uint region_end = region.second;
+
+        if( region_start >= region_end ) {
+            continue;
+        }
+
+        for( const GrandRun* run = &run_of( region_start );
+                run != grand_runs.data() + grand_runs.size() && run->first_bin < region_end; run++ ) {
+
+            uint first_bin = std::max( region_start, run->first_bin );
+            uint last_bin = std::min( region_end, run->first_bin + run->num_bins );
+
+            #pragma omp parallel for if( last_bin > first_bin + parallel_accumulate_bins )
+            for( uint i = first_bin; i < last_bin; i++ ) {
+
+                if( num_covering[i] == 0 ) {
+                    grand_power[i] = 0.0;
+                    grand_uncertainty[i] = 0.0;
+                } else {
+                    grand_power[i] = weighted_power[i]/total_weight[i];
+                    grand_uncertainty[i] = sqrt( 1.0/total_weight[i] );
+                }
+
+                double gc_power = ( grand_power[i] < 0 )? 0.0 : grand_power[i];
+                double excl_90_watts = gc_power + 1.282*grand_uncertainty[i];
+                double coupling = KSVZ_axion_coupling( run->mid_freq( i - run->first_bin ) );
+
+                limit_power[i] = coupling*sqrt( excl_90_watts );
+                limit_coupling[i] = coupling;
+            }
+        }
+
+        done_until = std::max( done_until, region_end );
+    }
+
+    dirty_regions.clear();
+}
+
+SingleSpectrum GrandAccumulator::Dense( const std::vector<double>& power, const std::vector<double>& uncertainty,
+                                        Units units ) const {
+
+    SingleSpectrum dense( 0u, min_frequency, max_frequency );
+    dense.sa_power_list.assign( grid_bins, 0.0 );
+    dense.uncertainties.assign( grid_bins, 0.0 );
+    dense.current_units = units;
+
+    for( const auto& run : grand_runs ) {
+        std::copy( power.begin() + run.first_bin, power.begin() + run.first_bin + run.num_bins,
+                   dense.sa_power_list.begin() + run.grid_offset );
+        std::copy( uncertainty.begin() + run.first_bin, uncertainty.begin() + run.first_bin + run.num_bins,
+                   dense.uncertainties.begin() + run.grid_offset );
+    }
+
+    return dense;
+}
+
+SingleSpectrum GrandAccumulator::GrandSpectrum() {
+
+    Refresh();
+    return Dense( grand_power, grand_uncertainty, Units::AxionPower );
+}
+
+std::vector<SingleSpectrum> GrandAccumulator::Runs( const std::vector<double>& power, const std::vector<double>& uncertainty,
+                                                    Units units ) const {
+
+    std::vector<SingleSpectrum> run_spectra;
+
+    for( const auto& run : grand_runs ) {
+        SingleSpectrum run_spectrum( 0u, run.min_freq, run.max_freq );
+        run_spectrum.sa_power_list.assign( power.begin() + run.first_bin, power.begin() + run.first_bin + run.num_bins );
+        run_spectrum.uncertainties.assign( uncertainty.begin() + run.first_bin,
+                                           uncertainty.begin() + run.first_bin + run.num_bins );
+        run_spectrum.current_units = units;
+
+        run_spectra.push_back( std::move( run_spectrum ) );
+    }
+
+    return run_spectra;
+}
+
+std::vector<SingleSpectrum> GrandAccumulator::GrandSpectrumRuns() {
+
+    Refresh();
+    return Runs( grand_power, grand_uncertainty, Units::AxionPower );
+}
+
+SingleSpectrum GrandAccumulator::UnbinnedLimits() {
+
+    Refresh();
+    return Dense( limit_power, limit_coupling, Units::ExclLimit90 );
+}
+
+std::vector<SingleSpectrum> GrandAccumulator::UnbinnedLimitRuns() {
+
+    Refresh();
+    return Runs( limit_power, limit_coupling, Units::ExclLimit90 );
+}
+
+SingleSpectrum GrandAccumulator::Limits( uint points_per_bin ) {
+
+    if( points_per_bin == 0 ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nBins must hold at least one point.";
+        throw std::invalid_argument(err_mesg);
+    }
+
+    Refresh();
+
+    //laid out exactly as UnbinnedLimits().rebin( points_per_bin ), points past the
+    //last whole limit bin are dropped and no longer belong to the span
+    uint grid_kept = grid_bins/points_per_bin*points_per_bin;
+
+    SingleSpectrum limits( 0u, min_frequency, max_frequency );
+    limits.sa_power_list.assign( grid_bins/points_per_bin, 0.0 );
+    limits.uncertainties.assign( grid_bins/points_per_bin, 0.0 );
+    limits.current_units = Units::ExclLimit90;
+    limits.ShrinkSpan( grid_kept, grid_bins );
+
+    //Limits are never negative and the dense grid is zero between runs, so the largest point
+    //of each limit bin is simply the largest point of any run falling in it (or zero)
+    for( const auto& run : grand_runs ) {
+
+        for( uint i = 0; i < run.num_bins && run.grid_offset + i < grid_kept; i++ ) {
+            uint bin = ( run.grid_offset + i )/points_per_bin;
+
+            limits.sa_power_list[bin] = std::max<spectrum_value>( limits.sa_power_list[bin], limit_power[run.first_bin + i] );
+            limits.uncertainties[bin] = std::max<spectrum_value>( limits.uncertainties[bin], limit_coupling[run.first_bin + i] );
+        }
+    }
+
+    return limits;
+}
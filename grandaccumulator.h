@@ -0,0 +1,313 @@
+#ifndef GRANDACCUMULATOR_H
+#define GRANDACCUMULATOR_H
+
+// C System-Headers
+#include <sys/types.h> //uint
+// C++ System headers
+#include <vector>      //vector
+#include <utility>     //std::pair
+#include <cmath>       //floor, pow
+#include <algorithm>   //std::min
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "alignedallocator.h"
+
+enum class Units;
+class SingleSpectrum;
+
+/*!
+ * \brief A spectrum taking part in a Grand Spectrum, with the constants that map a grand bin
+ * frequency to its own bin index- the same arithmetic as SingleSpectrum::bin_at_frequency().
+ */
+struct GrandSource {
+    double min_freq;
+    double frequency_span;
+    double num_bins;
+    const spectrum_value* power;
+    const spectrum_value* uncertainty;
+
+    uint bin( double frequency ) const {
+        double bin_number = std::floor( ( frequency - min_freq )/frequency_span*num_bins );
+
+        //frequency == max_freq belongs to the last bin, not one past it
+        return std::min( static_cast<uint>( bin_number ), static_cast<uint>( num_bins ) - 1 );
+    }
+};
+
+/*!
+ * \brief Weight \f$ \tau = 1/\sigma^2 \f$ of a point with uncertainty \f$ \sigma \f$ in a Grand Spectrum.
+ */
+inline double inverse_variance( double uncertainty ) {
+    return 1.0/pow( uncertainty, 2.0 );
+}
+
+/*!
+ * \brief How the width of the grand bins is chosen, see GrandGrid.
+ *
+ * Combined - num_bins is the total number of points in every spectrum, spread evenly over
+ *            the whole frequency range. Overlapping spectra therefore make grand bins narrower
+ *            than any spectrum actually resolves.
+ *
+ * Finest   - Grand bins are as wide as the narrowest bin of any spectrum.
+ *
+ * Fixed    - Grand bins are GrandGrid::bin_width wide.
+ */
+enum class GridSpacing {Combined, Finest, Fixed};
+
+/*!
+ * \brief Layout of the frequency grid of a Grand Spectrum, see Spectrum::SetGrandGrid().
+ *
+ * Unless spacing is GridSpacing::Combined, grand bins lie on a lattice of bin_width wide bins
+ * starting at the lowest frequency of any spectrum. A sparse grid only keeps the stretches of
+ * that lattice some spectrum actually covers (GrandRun), a dense grid keeps all of it.
+ */
+struct GrandGrid {
+    GridSpacing spacing;
+    bool sparse;
+    double bin_width; //MHz, only used with GridSpacing::Fixed
+};
+
+/*!
+ * \brief A stretch of evenly spaced grand bins, laid out exactly as the bins of
+ * SingleSpectrum( num_bins, min_freq, max_freq ).
+ */
+struct GrandRun {
+    double min_freq;
+    double max_freq;
+    double center_frequency;
+    double frequency_span;
+    uint num_bins;
+    uint grid_offset; //index of the first bin of the run in the dense grid, see GrandGrid
+    uint first_bin;   //index of the first bin of the run among all grand bins, set by GrandAccumulator
+
+    GrandRun( double min_freq, double max_freq, uint num_bins, uint grid_offset );
+
+    /*!
+     * \brief Get the mid frequency of bin i of the run, exactly as SingleSpectrum::bin_mid_freq() would.
+     */
+    double mid_freq( uint i ) const {
+        double freq_start = center_frequency - 0.5*frequency_span;
+        double bin_width = frequency_span/static_cast<double>( num_bins );
+
+        return freq_start + static_cast<double>( i )*frequency_span/static_cast<double>( num_bins ) + 0.5*bin_width;
+    }
+
+    /*!
+     * \brief Get the first bin of the run whose mid frequency is at least (or if inclusive is false,
+     * above) frequency, or num_bins if there is no such bin.
+     */
+    uint first_bin_from( double frequency, bool inclusive ) const;
+};
+
+/*!
+ * \brief Inverse-variance sums \f$ \sum_k \tau_k P_k \f$ and \f$ \sum_k \tau_k \f$, with
+ * \f$ \tau_k = 1/\sigma_k^2 \f$, of every spectrum covering each bin of a Grand Spectrum.
+ *
+ * The Grand Spectrum is then \f$ P = \sum \tau P / \sum \tau \f$ with uncertainty
+ * \f$ \sigma = 1/\sqrt{\sum \tau} \f$. Since these are plain sums a spectrum can be added to or
+ * removed from the Grand Spectrum by touching only the bins it covers. Grand Spectrum values and
+ * Limits are cached and only recomputed for bins that have changed since they were last asked for.
+ *
+ * The frequency grid is laid out when the accumulator is created, see Plan(). It is made of one or
+ * more runs of grand bins (GrandRun), whose bins are numbered consecutively from low to high
+ * frequency. A grand bin takes part in a spectrum if its mid frequency lies within that spectrum.
+ *
+ * Adding a spectrum that does not lie within a single run grows the grid by whole bins of the same
+ * width, so bins already summed keep their place on it. A sparse grid gains a new run (merged with
+ * any runs the spectrum touches), a dense grid extends its only run. This is only done while the
+ * grown grid is the one Plan() would lay out for the new set of spectra, see ChangesLayout(), so the
+ * grid never depends on the order spectra were added in. Removing a spectrum never shrinks the grid.
+ */
+class GrandAccumulator {
+
+  public:
+    /*!
+     * \brief An empty accumulator with no bins, which accepts nothing.
+     */
+    GrandAccumulator();
+
+    /*!
+     * \brief An accumulator with num_bins bins spread evenly between min_freq and max_freq,
+     * i.e. the same grid as SingleSpectrum( num_bins, min_freq, max_freq ).
+     *
+     * \param prototype
+     * Any of the spectra that will be added, only its units are used.
+     */
+    GrandAccumulator( double min_freq, double max_freq, uint num_bins, const SingleSpectrum& prototype );
+
+    /*!
+     * \brief An accumulator over the bins of runs, which must be in order of frequency, not
+     * overlap and lie on a lattice of bin_width wide bins starting at min_freq. The dense grid
+     * is the first grid_bins bins of the lattice. The bins of the runs are numbered in that order.
+     *
+     * \param grid
+     * How bin_width was chosen, and whether the grid grows by adding runs or by extending its
+     * only run, see GrandGrid.
+     *
+     * \param prototype
+     * Any of the spectra that will be added, only its units are used.
+     */
+    GrandAccumulator( std::vector<GrandRun> runs, double min_freq, double bin_width, uint grid_bins,
+                      const GrandGrid& grid, const SingleSpectrum& prototype );
+
+    /*!
+     * \brief Lay out the grid of a Grand Spectrum of spectra, using only their headers.
+     *
+     * With GridSpacing::Combined and a dense grid this is the grid Spectrum has always used,
+     * a single run of as many bins as all spectra have points between the lowest and highest frequency.
+     *
+     * \throws std::invalid_argument
+     * Thrown if spectra is empty, or the bin width of a GridSpacing::Fixed grid is not positive
+     * or too narrow to number every bin.
+     */
+    static GrandAccumulator Plan( const std::vector<SingleSpectrum>& spectra, const GrandGrid& grid );
+
+    /*!
+     * \brief Get the number of grand bins that are kept, i.e. summed over every run.
+     */
+    uint size() const;
+
+    /*!
+     * \brief Get the number of bins of the dense grid, i.e. the size of GrandSpectrum().
+     */
+    uint grid_size() const;
+
+    const std::vector<GrandRun>& runs() const;
+
+    /*!
+     * \brief Check whether spec can be added or removed, i.e. it has the same units as the
+     * accumulator, its uncertainties have been populated and the grid can grow to fit it.
+     */
+    bool Accepts( const SingleSpectrum& spec ) const;
+
+    /*!
+     * \brief Check whether spec lies within a single run, i.e. it can be added without growing the grid.
+     */
+    bool Covers( const SingleSpectrum& spec ) const;
+
+    /*!
+     * \brief Check whether adding (or if adding is false, removing) spec changes the grid Plan() would
+     * lay out by more than growing it, in which case the grid has to be laid out again.
+     *
+     * Always true for GridSpacing::Combined, since every spectrum changes the total number of points.
+     * For GridSpacing::Finest true if spec has narrower bins than the grid (or as narrow, when removing).
+     * Also true when adding a spectrum below the lowest frequency of the grid, since Plan() starts
+     * the lattice of grand bins at the lowest frequency of any spectrum.
+     */
+    bool ChangesLayout( const SingleSpectrum& spec, bool adding ) const;
+
+    /*!
+     * \brief Add spec to the Grand Spectrum, growing the grid if it does not cover spec.
+     *
+     * \throws std::invalid_argument
+     * Thrown if spec is not accepted, see Accepts().
+     */
+    void Add( const SingleSpectrum& spec );
+
+    /*!
+     * \brief Undo Add( spec ), spec must have the same values as when it was added.
+     *
+     * \throws std::invalid_argument
+     * Thrown if spec is not accepted (see Accepts()) or not covered (see Covers()).
+     */
+    void Remove( const SingleSpectrum& spec );
+
+    /*!
+     * \brief Get the Grand Spectrum of every spectrum added so far on the dense grid,
+     * bins between runs are zero.
+     */
+    SingleSpectrum GrandSpectrum();
+
+    /*!
+     * \brief Get the Grand Spectrum of every spectrum added so far, one SingleSpectrum per run.
+     */
+    std::vector<SingleSpectrum> GrandSpectrumRuns();
+
+    /*!
+     * \brief Get the 90% exclusion Limit of every bin of the dense grid, see Spectrum::UnbinnedLimits(),
+     * bins between runs (and their couplings) are zero.
+     */
+    SingleSpectrum UnbinnedLimits();
+
+    /*!
+     * \brief Get the 90% exclusion Limit of every grand bin, one SingleSpectrum per run.
+     */
+    std::vector<SingleSpectrum> UnbinnedLimitRuns();
+
+    /*!
+     * \brief Get the same Limits as UnbinnedLimits().rebin( points_per_bin ), but rebinned straight
+     * from each run so the dense grid is never filled in.
+     *
+     * \throws std::invalid_argument
+     * Thrown if points_per_bin is zero.
+     */
+    SingleSpectrum Limits( uint points_per_bin );
+
+    /*!
+     * \brief Get the mid frequency of grand bin i, exactly as SingleSpectrum::bin_mid_freq() of its run would.
+     */
+    double mid_freq( uint i ) const;
+
+    /*!
+     * \brief Get the grand bins [first, last) whose mid frequencies lie within [min_freq, max_freq],
+     * looking only at the run containing min_freq.
+     */
+    std::pair<uint, uint> covered_bins( double min_freq, double max_freq ) const;
+
+    /*!
+     * \brief Describe spec as a GrandSource.
+     *
+     * \throws std::invalid_argument
+     * Thrown if the uncertainties of spec have not been populated.
+     */
+    static GrandSource Source( const SingleSpectrum& spec );
+
+  private:
+    friend class Spectrum;
+
+    //the dense grid, i.e. what GrandSpectrum() returns
+    double min_frequency;
+    double max_frequency;
+    uint grid_bins;
+
+    //grand bin j of the lattice starts at lattice_origin + j*bin_width, the dense
+    //grid starts at lattice bin grid_start (which is negative once the grid has grown down)
+    double lattice_origin;
+    double bin_width;
+    long grid_start;
+    GridSpacing spacing;
+    bool sparse;
+
+    std::vector<GrandRun> grand_runs;
+    uint num_bins;
+    Units spectrum_units;
+
+    //sums over every spectrum covering each bin
+    std::vector<double> weighted_power;
+    std::vector<double> total_weight;
+    std::vector<uint> num_covering;
+
+    //Grand Spectrum and Limits, valid outside of dirty regions
+    std::vector<double> grand_power;
+    std::vector<double> grand_uncertainty;
+    std::vector<double> limit_power;
+    std::vector<double> limit_coupling;
+
+    //bins [first, last) changed since the caches were last brought up to date
+    std::vector< std::pair<uint, uint> > dirty_regions;
+
+    const GrandRun& run_of( uint i ) const;
+    const GrandRun& run_at( double frequency ) const;
+
+    void Accumulate( const SingleSpectrum& spec, double sign );
+    void Extend( double min_freq, double max_freq );
+    void Refresh();
+    SingleSpectrum Dense( const std::vector<double>& power, const std::vector<double>& uncertainty, Units units ) const;
+    std::vector<SingleSpectrum> Runs( const std::vector<double>& power, const std::vector<double>& uncertainty,
+                                      Units units ) const;
+};
+
+#endif // GRANDACCUMULATOR_H
@@ -0,0 +1,242 @@
+/*! \file grandcheck.cpp
+ * \brief Regression check for the incremental Grand Spectrum, see GrandAccumulator.
+ *
+ * Builds a Grand Spectrum from synthetic spectra one spectrum at a time, refreshing it as it
+ * goes, and compares it against a Grand Spectrum built from scratch on the same grid. Then it
+ * replaces one spectrum with a rescan, undoes the rescan, and finally removes all but one
+ * spectrum. This covers the dirty regions, bins moved when the grid is extended and the reset
+ * of bins no spectrum covers any more.
+ *
+ * Build it in place of the analysis with qmake CONFIG+=grand_check (see NouveauAnalysis.pro),
+ * and run it without arguments. It exits with a non-zero status if any comparison fails.
+ */
+
+// C System-Headers
+#include <cstdio>       //snprintf
+// C++ System headers
+#include <iostream>
+#include <cmath>        //std::abs
+#include <random>       //std::mt19937
+#include <string>
+#include <vector>
+#include <algorithm>    //std::max
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "spectrum.h"
+#include "singlespectrum.h"
+#include "spectrumview.h"
+#include "grandaccumulator.h"
+
+//number of synthetic spectra
+const uint num_spectra = 2000;
+//spectrum that is replaced by a rescan
+const uint rescan_idx = 777;
+//once spectra are removed again, the Grand Spectrum only matches a fresh build up to rounding.
+//It has to stay within this many sigma of it, and limits within this relative difference
+const double tolerance = 1e-12;
+
+/*!
+ * \brief Raw data file of a synthetic spectrum at center_freq, in the format
+ * FlatFileParser reads. Every spectrum is 1 MHz wide with 1024 points, so a
+ * GridSpacing::Finest grid keeps its layout as spectra are added.
+ */
+std::string Synthesize( std::mt19937& gen, uint idx, double center_freq ) {
+
+    std::uniform_real_distribution<double> noise( 0.0, 1.0 );
+    const uint num_points = 1024;
+
+    char header[512];
+    snprintf( header, sizeof header,
+              "sa_span;1\nfft_length;%u\neffective_volume;0.1\nbfield;1.54\nnoise_temperature;400\n"
+              "sa_averages;256\nQ;%g\nactual_center_freq;%.17g\nfitted_hwhm;15.7\ncavity_length;7.6\n@\n",
+              num_points, 128.0 + idx%10, center_freq );
+
+    std::string raw_data( header );
+    for( uint i = 0; i < num_points; i++ ) {
+        char line[32];
+        snprintf( line, sizeof line, "%.7f\n", -116.0 + noise( gen ) );
+        raw_data += line;
+    }
+
+    return raw_data;
+}
+
+SingleSpectrum SyntheticSpectrum( std::mt19937& gen, uint idx, double center_freq ) {
+
+    auto raw_data = Synthesize( gen, idx, center_freq );
+    SingleSpectrum spec( raw_data );
+    spec.ConvertToAxionPower();
+
+    return spec;
+}
+
+/*!
+ * \brief Largest difference between two spectra, or a negative value if their frequency grids
+ * differ or a value that is exactly zero in reference is not in spec.
+ *
+ * Grand Spectra are compared in units of the uncertainty of each bin of reference. Limits
+ * (relative = true) carry the KSVZ coupling in place of uncertainties, so they are compared
+ * relative to the value in reference instead.
+ */
+double MaxDeviation( const SingleSpectrum& spec, const SingleSpectrum& reference, bool relative = false ) {
+
+    if( spec.size() != reference.size() || spec.min_freq() != reference.min_freq()
+            || spec.max_freq() != reference.max_freq() ) {
+        return -1.0;
+    }
+
+    SpectrumView a( spec );
+    SpectrumView b( reference );
+
+    auto deviation_of = []( double value, double expected, double scale ) {
+        if( scale == 0.0 ) {
+            return ( value == expected )? 0.0 : -1.0;
+        }
+        return std::abs( value - expected )/scale;
+    };
+
+    double deviation = 0.0;
+    for( uint i = 0; i < b.size(); i++ ) {
+        double power_scale = std::abs( relative? b.power( i ) : b.uncertainty( i ) );
+        double power_deviation = deviation_of( a.power( i ), b.power( i ), power_scale );
+        double uncertainty_deviation = deviation_of( a.uncertainty( i ), b.uncertainty( i ), std::abs( b.uncertainty( i ) ) );
+        if( power_deviation < 0.0 || uncertainty_deviation < 0.0 ) {
+            return -1.0;
+        }
+        deviation = std::max( { deviation, power_deviation, uncertainty_deviation } );
+    }
+
+    return deviation;
+}
+
+bool Check( const std::string& what, double deviation, double limit ) {
+
+    bool passed = deviation >= 0.0 && deviation <= limit;
+    std::cout << "  " << ( passed ? "ok    " : "FAILED" ) << " " << what;
+    if( deviation < 0.0 ) {
+        std::cout << ": frequency grids or empty bins differ" << std::endl;
+    } else {
+        std::cout << ": max deviation " << deviation << std::endl;
+    }
+
+    return passed;
+}
+
+Spectrum FreshBuild( const std::vector<SingleSpectrum>& spectra, GridSpacing spacing, bool sparse ) {
+
+    Spectrum fresh;
+    fresh.SetGrandGrid( spacing, sparse, 0.002 );
+    for( const auto& spec : spectra ) {
+        fresh += spec;
+    }
+
+    return fresh;
+}
+
+uint CheckGrid( const std::vector<SingleSpectrum>& spectra, const SingleSpectrum& rescan,
+                GridSpacing spacing, bool sparse ) {
+
+    uint failures = 0;
+
+    //add one spectrum at a time, refreshing the limits every so often so that only
+    //dirty regions are recomputed, and the grid is extended as spectra are added above it
+    Spectrum live;
+    live.SetGrandGrid( spacing, sparse, 0.002 );
+    for( uint i = 0; i < spectra.size(); i++ ) {
+        live += spectra[i];
+        if( i%25 == 0 ) {
+            live.UnbinnedLimits();
+        }
+    }
+
+    //added in the same order as a fresh build, so the sums are bit-identical
+    auto fresh = FreshBuild( spectra, spacing, sparse );
+    auto grand = live.GrandSpectrum();
+    auto limits = live.UnbinnedLimits();
+    failures += !Check( "added one at a time", MaxDeviation( grand, fresh.GrandSpectrum() ), 0.0 );
+    failures += !Check( "limits added one at a time", MaxDeviation( limits, fresh.UnbinnedLimits(), true ), 0.0 );
+
+    //replace one spectrum with a rescan
+    auto rescanned = spectra;
+    rescanned[rescan_idx] = rescan;
+    live -= spectra[rescan_idx];
+    live += rescan;
+
+    auto fresh_rescan = FreshBuild( rescanned, spacing, sparse );
+    failures += !Check( "rescan", MaxDeviation( live.GrandSpectrum(), fresh_rescan.GrandSpectrum() ), tolerance );
+    failures += !Check( "limits rescan", MaxDeviation( live.UnbinnedLimits(), fresh_rescan.UnbinnedLimits(), true ), tolerance );
+
+    //undoing the rescan takes the same values back out, which restores the sums up to rounding
+    live -= rescan;
+    live += spectra[rescan_idx];
+    failures += !Check( "rescan undone", MaxDeviation( live.GrandSpectrum(), grand ), tolerance );
+    failures += !Check( "limits rescan undone", MaxDeviation( live.UnbinnedLimits(), limits, true ), tolerance );
+
+    //remove every spectrum but the first, bins no spectrum covers any more are reset to zero
+    while( live.size() > 1 ) {
+        live.erase( live.size() - 1 );
+    }
+
+    Spectrum first;
+    first.SetGrandGrid( spacing, sparse, 0.002 );
+    first += spectra.front();
+    auto remaining = live.GrandSpectrum();
+    //the grid never shrinks when spectra are removed, so compare over the first spectrum's bins
+    auto reference = first.GrandSpectrum();
+    SpectrumView view( remaining );
+    double deviation = 0.0;
+    for( uint i = 0; i < remaining.size(); i++ ) {
+        if( remaining.bin_mid_freq( i ) > reference.max_freq() ) {
+            if( view.power( i ) != 0.0 || view.uncertainty( i ) != 0.0 ) {
+                deviation = -1.0;
+                break;
+            }
+        } else {
+            uint j = reference.bin_at_frequency( remaining.bin_mid_freq( i ) );
+            double scale = SpectrumView( reference ).uncertainty( j );
+            deviation = std::max( deviation, std::abs( view.power( i ) - SpectrumView( reference ).power( j ) )/scale );
+        }
+    }
+    failures += !Check( "all but one removed", deviation, tolerance );
+
+    return failures;
+}
+
+int main() {
+
+    std::mt19937 gen( 11 );
+    std::uniform_real_distribution<double> step( 0.3, 0.7 );
+
+    //overlapping spectra in stretches of 200, with a gap between stretches for sparse grids
+    std::vector<SingleSpectrum> spectra;
+    double center_freq = 4000.5;
+    double rescan_freq = 0.0;
+    for( uint i = 0; i < num_spectra; i++ ) {
+        if( i == rescan_idx ) {
+            rescan_freq = center_freq;
+        }
+        spectra.push_back( SyntheticSpectrum( gen, i, center_freq ) );
+        center_freq += step( gen );
+        if( i%200 == 199 ) {
+            center_freq += 20.0;
+        }
+    }
+    auto rescan = SyntheticSpectrum( gen, rescan_idx, rescan_freq );
+
+    uint failures = 0;
+    GridSpacing spacings[] = { GridSpacing::Finest, GridSpacing::Fixed };
+    const char* names[] = { "Finest", "Fixed" };
+    for( uint s = 0; s < 2; s++ ) {
+        for( bool sparse : { false, true } ) {
+            std::cout << names[s] << ( sparse ? " sparse" : " dense" ) << " grid" << std::endl;
+            failures += CheckGrid( spectra, rescan, spacings[s], sparse );
+        }
+    }
+
+    std::cout << ( failures ? "FAILED" : "passed" ) << std::endl;
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,260 @@
+// Header for this file
+#include "ingestpipeline.h"
+// C System-Headers
+//
+// C++ System headers
+#include <vector>              //vector
+#include <string>              //string
+#include <deque>               //deque
+#include <map>                 //std::map
+#include <utility>             //std::pair, std::move
+#include <thread>              //std::thread
+#include <mutex>               //std::mutex
+#include <condition_variable>  //std::condition_variable
+#include <exception>           //std::exception_ptr
+#include <memory>              //std::unique_ptr
+#include <algorithm>           //std::max
+// Boost Headers
+#include <boost/utility/string_ref.hpp>  //string_ref
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "flatfileinterface.h"
+#include "singlespectrum.h"
+
+//Simple first-in first-out queue that blocks producers once it holds
+//capacity items, and blocks consumers while it is empty
+template <typename T>
+class BoundedQueue {
+
+  public:
+    BoundedQueue( uint capacity ) : capacity( std::max( capacity, 1u ) ) {}
+
+    //returns false if the queue was closed before the item could be added
+    bool push( T item ) {
+        std::unique_lock<std::mutex> lock( guard );
+        not_full.wait( lock, [this] { return items.size() < capacity || closed; } );
+
+        if( closed ) {
+            return false;
+        }
+
+        items.push_back( std::move( item ) );
+        not_empty.notify_one();
+        return true;
+    }
+
+    //returns false once the queue is closed and empty
+    bool pop( T& item ) {
+        std::unique_lock<std::mutex> lock( guard );
+        not_empty.wait( lock, [this] { return !items.empty() || closed; } );
+
+        if( items.empty() ) {
+            return false;
+        }
+
+        item = std::move( items.front() );
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock( guard );
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+  private:
+    uint capacity;
+    bool closed = false;
+
+    std::deque<T> items;
+    std::mutex guard;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+//A file waiting in the queue, held as the pipeline's LoadPolicy says
+struct QueuedFile {
+    uint index = 0;
+
+    //whichever of these the file was read into, kept until spec no longer refers to it
+    std::unique_ptr<std::string> raw_data;
+    CachedFile cached_file;
+    boost::string_ref raw_view;
+
+    bool built = false; //spec already holds the spectrum, whatever the LoadPolicy
+    SingleSpectrum spec { 0u };
+
+    void Release() {
+        raw_data.reset();
+        cached_file.cache.close();
+        raw_view.clear();
+    }
+};
+
+IngestPipeline::IngestPipeline( std::string dir_name, std::string sift_term, ReadMode mode, LoadPolicy policy,
+                                uint queue_depth, uint io_depth, uint worker_threads ) {
+
+    file_list = FlatFileReader::EnumerateFiles( dir_name, sift_term );
+    read_mode = mode;
+    load_policy = policy;
+
+    this->queue_depth = std::max( queue_depth, 1u );
+    this->io_depth = std::max( io_depth, 1u );
+    this->worker_threads = std::max( worker_threads, 1u );
+}
+
+IngestPipeline::~IngestPipeline() {}
+
+uint IngestPipeline::size() {
+    return file_list.size();
+}
+
+void IngestPipeline::Run( Spectrum& spectra, Stage process ) {
+
+    BoundedQueue<QueuedFile> raw_queue( queue_depth );
+
+    //Spectra may finish processing out of order, so hold on to them until
+    //every spectrum before them has been handed off
+    std::mutex hand_off_guard;
+    std::map< uint, SingleSpectrum > finished;
+    uint next_hand_off = 0;
+
+    //A file is only read once it is within queue_depth files of the next hand off,
+    //which bounds both raw_queue and finished. Since the file at next_hand_off is
+    //always in flight readers never wait on a spectrum that cannot be handed off.
+    std::condition_variable window_open;
+    uint next_file = 0;
+    bool stopped = false;
+
+    std::exception_ptr pipeline_error;
+    std::mutex error_guard;
+
+    auto fail = [&]( std::exception_ptr error ) {
+        std::lock_guard<std::mutex> lock( error_guard );
+        if( !pipeline_error ) {
+            pipeline_error = error;
+        }
+        raw_queue.close();
+
+        std::lock_guard<std::mutex> hand_off_lock( hand_off_guard );
+        stopped = true;
+        window_open.notify_all();
+    };
+
+    //returns false once there are no more files to read
+    auto claim_file = [&]( uint& index ) {
+        std::unique_lock<std::mutex> lock( hand_off_guard );
+        window_open.wait( lock, [&] { return next_file < next_hand_off + queue_depth || stopped; } );
+
+        if( stopped || next_file >= file_list.size() ) {
+            return false;
+        }
+
+        index = next_file++;
+        return true;
+    };
+
+    auto read_files = [&]() {
+        try {
+            uint i;
+
+            while( claim_file( i ) ) {
+                QueuedFile queued_file;
+                queued_file.index = i;
+
+                if( read_mode == ReadMode::Cached ) {
+                    queued_file.cached_file = FlatFileReader::CachedRead( file_list[i] );
+                    queued_file.raw_view = queued_file.cached_file.view();
+
+                    //without a usable cache the data file has just been parsed, so take
+                    //the spectrum straight from the parser
+                    if( queued_file.cached_file.parser ) {
+                        queued_file.spec = SingleSpectrum( *queued_file.cached_file.parser, load_policy );
+                        queued_file.cached_file.parser.reset();
+                        queued_file.built = true;
+                    }
+                } else {
+                    queued_file.raw_data.reset( new std::string( FlatFileReader::FastRead( file_list[i] ) ) );
+                    queued_file.raw_view = *queued_file.raw_data;
+                }
+
+                if( !queued_file.built && load_policy != LoadPolicy::Eager ) {
+                    queued_file.spec = SingleSpectrum( queued_file.raw_view, load_policy );
+                    queued_file.built = true;
+                }
+
+                //a quantized spectrum no longer refers to the raw data
+                if( load_policy == LoadPolicy::Quantized ) {
+                    queued_file.Release();
+                }
+
+                if( !raw_queue.push( std::move( queued_file ) ) ) {
+                    return;
+                }
+            }
+        } catch( ... ) {
+            fail( std::current_exception() );
+        }
+    };
+
+    auto process_files = [&]() {
+        try {
+            QueuedFile queued_file;
+
+            while( raw_queue.pop( queued_file ) ) {
+
+                SingleSpectrum spec = ( queued_file.built )? std::move( queued_file.spec )
+                                      : SingleSpectrum( queued_file.raw_view );
+
+                //decode whatever is still pending or quantized, after which the
+                //raw data is no longer needed
+                spec.Materialize();
+                queued_file.Release();
+
+                process( spec, queued_file.index );
+
+                std::lock_guard<std::mutex> lock( hand_off_guard );
+                finished.insert( std::make_pair( queued_file.index, std::move( spec ) ) );
+
+                for( auto it = finished.begin() ; it != finished.end() && it->first == next_hand_off ; ) {
+                    spectra += std::move( it->second );
+                    it = finished.erase( it );
+                    next_hand_off++;
+                }
+
+                window_open.notify_all();
+            }
+        } catch( ... ) {
+            fail( std::current_exception() );
+        }
+    };
+
+    std::vector<std::thread> readers;
+    for( uint i = 0 ; i < io_depth ; i++ ) {
+        readers.push_back( std::thread( read_files ) );
+    }
+
+    std::vector<std::thread> workers;
+    for( uint i = 0 ; i < worker_threads ; i++ ) {
+        workers.push_back( std::thread( process_files ) );
+    }
+
+    for( auto& reader : readers ) {
+        reader.join();
+    }
+
+    //let workers drain whatever is left, then stop
+    raw_queue.close();
+
+    for( auto& worker : workers ) {
+        worker.join();
+    }
+
+    if( pipeline_error ) {
+        std::rethrow_exception( pipeline_error );
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef INGESTPIPELINE_H
+#define INGESTPIPELINE_H
+
+// C System-Headers
+//
+// C++ System headers
+#include <vector>      //vector
+#include <string>      //string
+#include <functional>  //std::function
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "spectrum.h"
+#include "flatfileinterface.h"
+#include "singlespectrum.h"
+
+/*!
+ * \brief Object that streams every data file in a directory from disk into a Spectrum,
+ * without ever holding the whole data run in memory as raw text.
+ *
+ * Unlike a FlatFileReader, which loads every file up front, an IngestPipeline runs
+ * the following stages concurrently:
+ *
+ * \li Read - io_depth threads read files (or their binary spectrum caches, see
+ * ReadMode::Cached) from disk into a queue of raw buffers.
+ * \li Process - worker threads parse each buffer into a SingleSpectrum, release the
+ * raw buffer and then run a user supplied processing stage (e.g. background subtraction
+ * and initial binning). Depending on the LoadPolicy given, readers may already have
+ * decoded part or all of each file, see IngestPipeline::IngestPipeline.
+ * \li Hand off - processed spectra are added to a Spectrum in order of file index.
+ *
+ * At most queue_depth files are in flight at once, whether they are being read, waiting
+ * to be processed or waiting for an earlier file to be handed off. Readers wait for the
+ * hand off to catch up before reading any further, so the memory used by the pipeline is
+ * bounded no matter how long the data run is, while disk IO still overlaps with filtering.
+ */
+class IngestPipeline {
+
+  public:
+    /*!
+     * \brief A processing stage, called once for every spectrum as soon as it is parsed.
+     *
+     * The first argument is the freshly parsed spectrum (in Watts), the second is the
+     * index of the file it came from. Any changes made to the spectrum are kept.
+     */
+    typedef std::function< void( SingleSpectrum&, uint ) > Stage;
+
+    /*!
+     * \brief Set up a new pipeline, no files are read until Run() is called.
+     *
+     * \param dir_name
+     * File path to the directory containing data collected by Electric Tiger
+     *
+     * \param sift_term
+     * Only files containing sift_term in their names will be loaded, see FlatFileReader::FlatFileReader
+     *
+     * \param mode
+     * ReadMode::Cached reads each file through its binary spectrum cache, writing the cache
+     * first if needed (in which case readers parse the data file, whatever the policy, and the
+     * cache is not read back). Any other mode reads the data files themselves.
+     *
+     * \param policy
+     * How files are held while they wait to be processed, see LoadPolicy.\n
+     * LoadPolicy::Eager - the raw data is queued and parsed by a worker.\n
+     * LoadPolicy::Lazy - readers decode the header, the power values are decoded by a worker.\n
+     * LoadPolicy::Quantized - readers parse each file and queue only its quantized power values,
+     * so the queue holds 2 bytes per point rather than the raw text. Power values passed to the
+     * processing stage are rounded, see LoadPolicy.
+     *
+     * \param queue_depth
+     * The maximum number of files that may be in flight at once.
+     *
+     * \param io_depth
+     * The maximum number of files that will be read from disk at once.
+     *
+     * \param worker_threads
+     * The number of spectra processed at once. Note that the filters in spectrumfilter.h
+     * are already parallel, so one worker is usually enough to keep every core busy.
+     */
+    IngestPipeline( std::string dir_name, std::string sift_term, ReadMode mode = ReadMode::Copy,
+                    LoadPolicy policy = LoadPolicy::Eager, uint queue_depth = 8, uint io_depth = 2, uint worker_threads = 1 );
+    ~IngestPipeline();
+
+    /*!
+     * \brief Stream every data file through the pipeline.
+     *
+     * \param spectra
+     * Spectrum that each processed spectrum will be added to, in order of file index.
+     *
+     * \param process
+     * Processing stage run on each spectrum before it is added to spectra.
+     *
+     * \throws std::invalid_argument
+     * Rethrown from whichever stage failed first, once every thread has stopped.
+     */
+    void Run( Spectrum& spectra, Stage process );
+
+    /*!
+     * \brief Similar to std::vector::size(), get the number of data files found.
+     */
+    uint size();
+
+  private:
+    std::vector<std::string> file_list;
+    ReadMode read_mode;
+    LoadPolicy load_policy;
+
+    uint queue_depth;
+    uint io_depth;
+    uint worker_threads;
+};
+
+#endif // INGESTPIPELINE_H
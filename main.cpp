@@ -1,4 +1,6 @@
 #include "flatfileinterface.h"
+#include "ingestpipeline.h"
+#include "runwatcher.h"
 #include "spectrum.h"
 #include "singlespectrum.h"
 #include "spectrumfilter.h"
@@ -24,60 +26,55 @@
  *
  */
 
-void Analysis() {
-    auto start = std::chrono::high_resolution_clock::now();
-
-    Spectrum spectra;
+void BackgroundSubtract( SingleSpectrum& spec, uint j ) {
 
-    for (int i = 0 ; i < 1 ; i++) {
-        auto Reader = FlatFileReader("/home/bephillips2/workspace/Electric_Tiger_Control_Code/data/27_20_00_20.08.2016/", "SA_F");
-//        auto Reader = FlatFileReader("/home/bephillips2/workspace/Electric_Tiger_Control_Code/data/09_56_11_17.08.2016/");
+    std::cout << "Loading spectrum "<< j << std::endl;
 
-        for( uint j = 0 ; j < Reader.size() ; j ++) {
-
-            std::cout << "Loading spectrum "<< j << std::endl;
-            auto spec = SingleSpectrum( Reader.at(j) ) ;
+    //Note that all background subtraction steps should be perfomred -before-
+    //initial binning
+    if( j == 20 ) {
+        plot( spec, "Single Digitized Power Spectrum" );
+    }
 
-            //Note that all background subtraction steps should be perfomred -before-
-            //initial binning
-            if( j == 20 ) {
-                plot( spec, "Single Digitized Power Spectrum" );
-            }
+    auto opt_parameters = AutoOptimize( spec, 10, 5 );
 
-            auto opt_parameters = AutoOptimize( spec, 10, 5 );
+    uint opt_radius = opt_parameters.first;
+    double opt_sigma = opt_parameters.second;
 
-            uint opt_radius = opt_parameters.first;
-            double opt_sigma = opt_parameters.second;
+    std::cout << "Optimal Parameters: " << opt_radius << "," << opt_sigma << std::endl;
 
-            std::cout << "Optimal Parameters: " << opt_radius << "," << opt_sigma << std::endl;
+    UnsharpMask( spec, opt_radius, opt_sigma );
 
-            UnsharpMask( spec, opt_radius, opt_sigma );
+    if( j == 20 ) {
+        plot( spec, "Background Subtracted Power Spectrum");
+    }
+    spec.InitialBin( 32 );
+}
 
-            if( j == 20 ) {
-                plot( spec, "Background Subtracted Power Spectrum");
-            }
-            spec.InitialBin( 32 );
+void Analysis() {
+    auto start = std::chrono::high_resolution_clock::now();
 
-            spectra += spec;
-        }
-    }
+    Spectrum spectra;
 
-    //Note each spectra is implicitly converted from dBm to watts during
-    //initialization, so we only need to convert to excess power
+    //Same grid as Watch(), so limits of a data run are identical however it was loaded
+    spectra.SetGrandGrid( GridSpacing::Finest );
 
-    std::cout << "Converting to units of excess power." << std::endl;
-    spectra.WattsToExcessPower();
+    //Files are streamed from disk, so only a handful of raw files are
+    //ever held in memory at once. Each file is read through its binary
+    //cache, so only the first analysis of a data run parses the text.
+    auto Pipeline = IngestPipeline("/home/bephillips2/workspace/Electric_Tiger_Control_Code/data/27_20_00_20.08.2016/", "SA_F", ReadMode::Cached);
+//    auto Pipeline = IngestPipeline("/home/bephillips2/workspace/Electric_Tiger_Control_Code/data/09_56_11_17.08.2016/", "SA_F", ReadMode::Cached);
 
-    auto e_spec = spectra.at(20);
-    plot( e_spec, "Excess Power Spectra" );
+    Pipeline.Run( spectra, BackgroundSubtract );
 
-    std::cout << "Weighting spectra by expected axion power." << std::endl;
+    //Note each spectra is implicitly converted from dBm to watts during
+    //initialization, so we only need to convert to excess power and weight
+    //by expected axion power- both are done in a single pass
 
-    spectra.LorentzianWeight();
-    spectra.KSVZWeight();
+    std::cout << "Converting to units of axion power." << std::endl;
+    spectra.ConvertToAxionPower();
 
-    auto ax_spec = spectra.at(20);
-    plot( ax_spec, "Axion Power Spectra" );
+    plot( spectra.at(20), "Axion Power Spectra" );
 
     std::cout << "Building grand spectra." << std::endl;
     auto g_spec = spectra.GrandSpectrum();
@@ -99,9 +96,50 @@ void Analysis() {
     std::cout<<"Took "<<time_taken<<" ms."<<std::endl;
 }
 
-int main() {
+void Watch( std::string run_dir ) {
 
-    Analysis();
+    Spectrum spectra;
+
+    //Grand bins as wide as the finest spectrum, so each new spectrum is folded into the
+    //limits rather than laying the whole grid out again, see Spectrum::SetGrandGrid()
+    spectra.SetGrandGrid( GridSpacing::Finest );
+
+    //Follow a data run, updating limits as each spectrum is written. The watch does not
+    //look into sub-directories, so this must be the directory of the run itself.
+    RunWatcher Watcher( run_dir, "SA_F" );
+
+    auto process = [] ( SingleSpectrum& spec, uint j ) {
+        BackgroundSubtract( spec, j );
+
+        spec.ConvertToAxionPower();
+    };
+
+    auto update = [] ( Spectrum& spectra, const std::string& file_name ) {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        auto limits = spectra.Limits();
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> fp_ms = end - start;
+
+        std::cout << "Added " << file_name << ", "<< spectra.size() << " spectra in total." << std::endl;
+        std::cout << "Updated limits in " << fp_ms.count() << " ms." << std::endl;
+        plot ( limits, "Limits" );
+
+        return true;
+    };
+
+    Watcher.Watch( spectra, process, update );
+}
+
+int main( int argc, char* argv[] ) {
+
+    //NouveauAnalysis --watch <run directory> follows a data run as it is taken
+    if( argc == 3 && std::string( argv[1] ) == "--watch" ) {
+        Watch( argv[2] );
+    } else {
+        Analysis();
+    }
 //    Optimize();
 
 }
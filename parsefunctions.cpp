@@ -0,0 +1,265 @@
+// Header for this file
+#include "parsefunctions.h"
+// C System-Headers
+#include <string.h>  //memchr()
+#include <stdlib.h>  //strtod_l()
+#include <locale.h>  //newlocale()
+// C++ System headers
+#include <cstdint>     //uint64_t
+#include <string>      //string
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+//
+
+//Every power of ten that can be represented exactly as a double
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+//Largest integer below which every integer can be represented exactly as a double
+static const uint64_t max_exact_mantissa = 1ull << 53;
+
+//Mantissas are accumulated in 64 bits, digits beyond this point are dropped
+static const int max_mantissa_digits = 19;
+
+inline bool is_digit( char c ) {
+    return static_cast<unsigned char>( c - '0' ) < 10;
+}
+
+inline bool is_blank( char c ) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char* find_line_end( const char* pos, const char* end ) {
+    return find_delimiter( pos, end, '\n' );
+}
+
+const char* find_delimiter( const char* pos, const char* end, char delim ) {
+    if( pos >= end ) {
+        return end;
+    }
+
+    const void* found = memchr( pos, delim, end - pos );
+    return ( found == nullptr )? end : static_cast<const char*>( found );
+}
+
+//Decode using the C library, forced into the "C" locale. Only used for
+//numbers that cannot be decoded exactly by parse_double
+const char* slow_parse_double( const char* pos, const char* end, double& value ) {
+
+    static locale_t c_locale = newlocale( LC_ALL_MASK, "C", static_cast<locale_t>(0) );
+
+    //strtod requires a null terminated string, so copy the token onto the stack.
+    //No valid number in our data files comes close to this length.
+    char buffer[128];
+    size_t length = 0;
+
+    while( pos + length < end && length < sizeof( buffer ) - 1 &&
+            pos[length] != '\n' && pos[length] != ';' ) {
+        buffer[length] = pos[length];
+        length++;
+    }
+    buffer[length] = '\0';
+
+    char* token_end = nullptr;
+    double result = strtod_l( buffer, &token_end, c_locale );
+
+    if( token_end == buffer ) {
+        return nullptr;
+    }
+
+    value = result;
+    return pos + ( token_end - buffer );
+}
+
+const char* parse_double( const char* pos, const char* end, double& value ) {
+
+    while( pos < end && is_blank( *pos ) ) {
+        pos++;
+    }
+
+    const char* start = pos;
+
+    bool negative = false;
+    if( pos < end && ( *pos == '-' || *pos == '+' ) ) {
+        negative = ( *pos == '-' );
+        pos++;
+    }
+
+    uint64_t mantissa = 0;
+    int significant_digits = 0;
+    int exponent = 0;
+    bool any_digits = false;
+    bool truncated = false;
+
+    //integer part
+    for( ; pos < end && is_digit( *pos ) ; pos++ ) {
+        any_digits = true;
+
+        if( significant_digits < max_mantissa_digits ) {
+            mantissa = mantissa*10 + ( *pos - '0' );
+            significant_digits += ( mantissa != 0 );
+        } else {
+            exponent++;
+            truncated = true;
+        }
+    }
+
+    //fractional part
+    if( pos < end && *pos == '.' ) {
+        pos++;
+
+        for( ; pos < end && is_digit( *pos ) ; pos++ ) {
+            any_digits = true;
+
+            if( significant_digits < max_mantissa_digits ) {
+                mantissa = mantissa*10 + ( *pos - '0' );
+                significant_digits += ( mantissa != 0 );
+                exponent--;
+            } else {
+                truncated = true;
+            }
+        }
+    }
+
+    if( !any_digits ) {
+        //could be "inf", "nan" or similar
+        return slow_parse_double( start, end, value );
+    }
+
+    //exponent part, only consumed if it is well formed
+    if( pos < end && ( *pos == 'e' || *pos == 'E' ) ) {
+
+        const char* exp_pos = pos + 1;
+        bool exp_negative = false;
+
+        if( exp_pos < end && ( *exp_pos == '-' || *exp_pos == '+' ) ) {
+            exp_negative = ( *exp_pos == '-' );
+            exp_pos++;
+        }
+
+        if( exp_pos < end && is_digit( *exp_pos ) ) {
+            int exp_value = 0;
+
+            for( ; exp_pos < end && is_digit( *exp_pos ) ; exp_pos++ ) {
+                //saturate, anything this large over/underflows anyway
+                if( exp_value < 100000 ) {
+                    exp_value = exp_value*10 + ( *exp_pos - '0' );
+                }
+            }
+
+            exponent += ( exp_negative )? -exp_value : exp_value;
+            pos = exp_pos;
+        }
+    }
+
+    //Both the mantissa and the power of ten are exact, so a single multiplication
+    //or division gives a correctly rounded result
+    if( !truncated && mantissa <= max_exact_mantissa && exponent >= -22 && exponent <= 22 ) {
+
+        double result = static_cast<double>( mantissa );
+        result = ( exponent < 0 )? result/exact_powers_of_ten[-exponent] : result*exact_powers_of_ten[exponent];
+
+        value = ( negative )? -result : result;
+        return pos;
+    }
+
+    return slow_parse_double( start, end, value );
+}
+
+bool parse_field( const char* pos, const char* end, double& value ) {
+
+    const char* number_end = parse_double( pos, end, value );
+
+    if( number_end == nullptr ) {
+        return false;
+    }
+
+    while( number_end < end && is_blank( *number_end ) ) {
+        number_end++;
+    }
+
+    return number_end == end;
+}
+
+size_t count_lines( const char* pos, const char* end ) {
+
+    size_t num_lines = 0;
+
+    while( pos < end ) {
+
+        const char* eol = find_line_end( pos, end );
+
+        //nearly every line starts with its number, so this is usually a single comparison
+        while( pos < eol && is_blank( *pos ) ) {
+            pos++;
+        }
+
+        num_lines += ( pos < eol );
+        pos = eol + 1;
+    }
+
+    return num_lines;
+}
+
+const char* parse_lines( const char* pos, const char* end, PowerList& values ) {
+
+    while( pos < end ) {
+
+        double value;
+        const char* number_end = parse_double( pos, end, value );
+
+        if( number_end != nullptr ) {
+            values.push_back( value );
+        } else {
+            number_end = pos;
+        }
+
+        while( number_end < end && is_blank( *number_end ) ) {
+            number_end++;
+        }
+
+        //anything other than the end of the line means this line was not a number
+        if( number_end < end && *number_end != '\n' ) {
+            return pos;
+        }
+
+        pos = number_end + 1;
+    }
+
+    return nullptr;
+}
+
+const char* parse_lines( const char* pos, const char* end, spectrum_value* values, size_t& num_values ) {
+
+    num_values = 0;
+
+    while( pos < end ) {
+
+        double value;
+        const char* number_end = parse_double( pos, end, value );
+
+        if( number_end != nullptr ) {
+            values[num_values++] = value;
+        } else {
+            number_end = pos;
+        }
+
+        while( number_end < end && is_blank( *number_end ) ) {
+            number_end++;
+        }
+
+        //anything other than the end of the line means this line was not a number
+        if( number_end < end && *number_end != '\n' ) {
+            return pos;
+        }
+
+        pos = number_end + 1;
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,106 @@
+#ifndef PARSEFUNCTIONS_H
+#define PARSEFUNCTIONS_H
+
+// C System-Headers
+//
+// C++ System headers
+#include <cstddef>     //size_t
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "alignedallocator.h"
+
+/*! \file
+ * \brief Locale-free, allocation-free routines used to scan and decode the
+ * plain text data files written by Electric Tiger.
+ *
+ * All functions operate on a half-open range of characters [pos, end), which
+ * need not be null terminated- so they may be used directly on memory mapped files.
+ */
+
+/*!
+ * \brief Find the end of the line starting at pos.
+ *
+ * The search is done with memchr, which is vectorized by most C libraries, rather
+ * than a character-by-character loop.
+ *
+ * \return
+ * A pointer to the next newline character, or end if there is none.
+ */
+const char* find_line_end( const char* pos, const char* end );
+
+/*!
+ * \brief Find the first occurence of the character delim in [pos, end)
+ *
+ * \return
+ * A pointer to delim, or end if delim could not be found.
+ */
+const char* find_delimiter( const char* pos, const char* end, char delim );
+
+/*!
+ * \brief Decode a single floating point number, in either fixed ("-116.0639877")
+ * or scientific ("1.54e-3") notation.
+ *
+ * Numbers with at most 15 significant digits and a small exponent, such as those
+ * written by our spectrum analyzer, are decoded exactly without calling into the C library.
+ * Anything else (very long mantissas, "inf", "nan" etc.) falls back to strtod in the "C" locale.
+ *
+ * \param pos
+ * The first character of the number, leading blanks are skipped.
+ *
+ * \param end
+ * One past the last character that may be read.
+ *
+ * \param value
+ * Set to the decoded value on success, untouched otherwise.
+ *
+ * \return
+ * A pointer one past the last character of the number, or nullptr if no number
+ * could be decoded.
+ */
+const char* parse_double( const char* pos, const char* end, double& value );
+
+/*!
+ * \brief Decode a field that must contain a single number and nothing else
+ * ( other than surrounding blanks or a trailing carriage return ).
+ *
+ * \return
+ * true if the whole of [pos, end) was a valid number.
+ */
+bool parse_field( const char* pos, const char* end, double& value );
+
+/*!
+ * \brief Count the lines of [pos, end) that are not blank, i.e. the number of values
+ * parse_lines() decodes if every line is a valid number, without decoding any of them.
+ */
+size_t count_lines( const char* pos, const char* end );
+
+/*!
+ * \brief Decode a list of numbers, one per line, in a single pass.
+ *
+ * Blank lines are skipped. Decoded values are appended to the back of values.
+ *
+ * \return
+ * nullptr if every line was decoded, otherwise a pointer to the start of the first
+ * line that is not a valid number.
+ */
+const char* parse_lines( const char* pos, const char* end, PowerList& values );
+
+/*!
+ * \brief Decode a list of numbers, one per line, into preallocated memory.
+ *
+ * Identical to the PowerList version, except that values are written one after another
+ * starting at values. The caller must make sure there is room for one value per line in [pos, end).
+ *
+ * \param num_values
+ * Set to the number of values written.
+ *
+ * \return
+ * nullptr if every line was decoded, otherwise a pointer to the start of the first
+ * line that is not a valid number.
+ */
+const char* parse_lines( const char* pos, const char* end, spectrum_value* values, size_t& num_values );
+
+#endif // PARSEFUNCTIONS_H
@@ -17,6 +17,7 @@ double axion_width ( double frequency );
  * frequency (in MHz)
  * \return the coupling term in GeV^-1
  */
+#pragma omp declare simd
 double KSVZ_axion_coupling( double frequency );
 
 /*!
@@ -38,6 +39,7 @@ double KSVZ_axion_coupling( double frequency );
  *
  * \return value of the lorentzian at point omega
  */
+#pragma omp declare simd
 double lorentzian (double f0, double omega, double Q );
 
 /*!
@@ -55,6 +57,7 @@ double lorentzian (double f0, double omega, double Q );
  * Quality Factor (unitless)
  * \return
  */
+#pragma omp declare simd
 double max_ksvz_power(double effective_volume, double b_field, double frequency, double Q);
 
 /*!
@@ -74,7 +77,11 @@ double power_per_bin( double noise_temperature, double bin_width );
 
 /*!
  * \brief Convert from units of dBm to units of watts
+ *
+ * This function, KSVZ_axion_coupling, lorentzian and max_ksvz_power are declared
+ * simd so that they may be called from vectorized loops over whole spectra.
  */
+#pragma omp declare simd
 double dbm_to_watts ( double power_dbm );
 
 #endif // PHYSICSFUNCTIONS_H
@@ -12,7 +12,8 @@
 // Project specific headers
 //
 
-void plot ( SingleSpectrum& spec, std::string plot_title, std::string save_file_path ) {
+void plot ( const SingleSpectrum& spec, std::string plot_title, std::string save_file_path ) {
+    spec.Materialize();
 
     Gnuplot gp;
 
@@ -39,10 +40,13 @@ void plot ( SingleSpectrum& spec, std::string plot_title, std::string save_file_
         cmd.insert (0,header);
     }
     gp << cmd;
-    gp.send( boost::make_tuple( x_vals, spec.sa_power_list ) );
+
+    std::vector<double> y_vals( spec.sa_power_list.begin(), spec.sa_power_list.end() );
+    gp.send( boost::make_tuple( x_vals, y_vals ) );
 }
 
-void plot ( SingleSpectrum& spec, uint num_plot_points, std::string plot_title, std::string save_file_path ) {
+void plot ( const SingleSpectrum& spec, uint num_plot_points, std::string plot_title, std::string save_file_path ) {
+    spec.Materialize();
 
     Gnuplot gp;
 
@@ -0,0 +1,223 @@
+// Header for this file
+#include "runmanifest.h"
+// C System-Headers
+#include <stdio.h>   //fopen(), fprintf()
+#include <unistd.h>  //access()
+// C++ System headers
+#include <vector>      //vector
+#include <string>      //string
+#include <map>         //std::map
+#include <iostream>    //cout
+#include <mutex>       //std::mutex
+#include <exception>   //std::exception_ptr
+#include <algorithm>   //std::max
+// Boost Headers
+//
+// Miscellaneous Headers
+#include <omp.h>  //OpenMP pragmas
+//Project Specific Headers
+#include "flatfileinterface.h"
+#include "parsefunctions.h"
+
+//First line of every manifest, bumped whenever the layout changes
+static const std::string manifest_signature = "tigerlyzer_manifest;1";
+
+double RunManifest::Entry::min_freq() const {
+    return header.at( "actual_center_freq" ) - 0.5*header.at( "sa_span" );
+}
+
+double RunManifest::Entry::max_freq() const {
+    return header.at( "actual_center_freq" ) + 0.5*header.at( "sa_span" );
+}
+
+RunManifest::RunManifest( std::string dir_name, std::string sift_term, uint io_depth ) {
+
+    manifest_name = dir_name + sift_term + run_manifest_extension;
+
+    std::vector<std::string> file_list = FlatFileReader::EnumerateFiles( dir_name, sift_term );
+    std::map<std::string, Entry> saved_entries = LoadManifest( dir_name );
+
+    entries.resize( file_list.size() );
+    std::vector<uint> stale_entries;
+
+    for ( uint i = 0 ; i < file_list.size() ; i ++ ) {
+
+        auto& entry = entries[i];
+        entry.file_name = file_list[i];
+        GetFileStamp( entry.file_name, entry.file_size, entry.file_mtime );
+
+        auto saved = saved_entries.find( entry.file_name );
+
+        if ( saved != saved_entries.end() &&
+                saved->second.file_size == entry.file_size &&
+                saved->second.file_mtime == entry.file_mtime ) {
+            entry.header = saved->second.header;
+        } else {
+            stale_entries.push_back( i );
+        }
+    }
+
+    //Only headers are read, so this is cheap even for very long runs
+    std::exception_ptr scan_error;
+    std::mutex guard;
+
+    #pragma omp parallel for num_threads( std::max( io_depth, 1u ) ) schedule( dynamic )
+    for ( uint i = 0 ; i < stale_entries.size() ; i ++ ) {
+        try {
+            auto& entry = entries[ stale_entries[i] ];
+            FlatFileParser parser( FlatFileReader::ReadHeader( entry.file_name ) );
+            entry.header = parser.GetHeader();
+        } catch ( ... ) {
+            std::lock_guard<std::mutex> lock ( guard );
+            if ( !scan_error ) {
+                scan_error = std::current_exception();
+            }
+        }
+    }
+
+    if ( scan_error ) {
+        std::rethrow_exception( scan_error );
+    }
+
+    if ( !stale_entries.empty() || saved_entries.size() != entries.size() ) {
+        if ( !SaveManifest() ) {
+            std::cout << "Could not save run manifest " << manifest_name << std::endl;
+        }
+    }
+}
+
+RunManifest::~RunManifest() {}
+
+uint RunManifest::size() {
+    return entries.size();
+}
+
+const RunManifest::Entry& RunManifest::at( uint idx ) {
+    return entries.at( idx );
+}
+
+std::vector<std::string> RunManifest::FilesInRange( double f_min, double f_max ) {
+
+    std::vector<std::string> file_list;
+
+    for ( const auto& entry : entries ) {
+
+        if ( !entry.header.count( "actual_center_freq" ) || !entry.header.count( "sa_span" ) ) {
+            continue;
+        }
+
+        if ( entry.max_freq() >= f_min && entry.min_freq() <= f_max ) {
+            file_list.push_back( entry.file_name );
+        }
+    }
+
+    return file_list;
+}
+
+//Split a manifest line into its ';' separated fields
+inline std::vector<std::string> split_fields( const char* pos, const char* end ) {
+
+    std::vector<std::string> fields;
+
+    while ( pos <= end ) {
+        const char* delim = find_delimiter( pos, end, ';' );
+        fields.push_back( std::string( pos, delim ) );
+        pos = delim + 1;
+    }
+
+    return fields;
+}
+
+std::map<std::string, RunManifest::Entry> RunManifest::LoadManifest( std::string dir_name ) {
+
+    std::map<std::string, Entry> saved_entries;
+
+    if ( access( manifest_name.c_str(), R_OK ) != 0 ) {
+        return saved_entries;
+    }
+
+    std::string contents = FlatFileReader::FastRead( manifest_name );
+
+    const char* pos = contents.data();
+    const char* end = contents.data() + contents.size();
+
+    const char* eol = find_line_end( pos, end );
+
+    if ( std::string( pos, eol ) != manifest_signature ) {
+        return saved_entries;
+    }
+
+    //Every line has the form "file_name;size;mtime;parameter;value;parameter;value..."
+    //Anything malformed means the whole manifest is rebuilt.
+    for ( pos = eol + 1 ; pos < end ; pos = eol + 1 ) {
+
+        eol = find_line_end( pos, end );
+        auto fields = split_fields( pos, eol );
+
+        if ( fields.size() < 3 || ( fields.size() - 3 ) % 2 != 0 ) {
+            return std::map<std::string, Entry>();
+        }
+
+        Entry entry;
+        entry.file_name = dir_name + fields[0];
+
+        try {
+            entry.file_size = std::stoull( fields[1] );
+            entry.file_mtime = std::stoll( fields[2] );
+        } catch ( const std::exception& ) {
+            return std::map<std::string, Entry>();
+        }
+
+        for ( uint i = 3 ; i < fields.size() ; i += 2 ) {
+            const auto& val = fields[i + 1];
+
+            if ( !parse_field( val.data(), val.data() + val.size(), entry.header[ fields[i] ] ) ) {
+                return std::map<std::string, Entry>();
+            }
+        }
+
+        saved_entries[entry.file_name] = entry;
+    }
+
+    return saved_entries;
+}
+
+bool RunManifest::SaveManifest() {
+
+    //write to a temporary file first, so that a half written manifest is never read
+    std::string temp_name = manifest_name + ".tmp";
+    FILE* manifest_file = std::fopen( temp_name.c_str(), "w" );
+
+    if ( manifest_file == NULL ) {
+        return false;
+    }
+
+    bool written = std::fprintf( manifest_file, "%s\n", manifest_signature.c_str() ) > 0;
+
+    for ( const auto& entry : entries ) {
+
+        //store names relative to the data directory, so runs can be moved
+        std::string base_name = entry.file_name.substr( entry.file_name.find_last_of( '/' ) + 1 );
+
+        written = written && std::fprintf( manifest_file, "%s;%llu;%lld",
+                                           base_name.c_str(),
+                                           static_cast<unsigned long long>( entry.file_size ),
+                                           static_cast<long long>( entry.file_mtime ) ) > 0;
+
+        for ( const auto& key_val : entry.header ) {
+            //17 significant digits are enough for every value to be read back exactly
+            written = written && std::fprintf( manifest_file, ";%s;%.17g", key_val.first.c_str(), key_val.second ) > 0;
+        }
+
+        written = written && std::fputc( '\n', manifest_file ) != EOF;
+    }
+
+    written = ( std::fclose( manifest_file ) == 0 ) && written;
+
+    if ( !written || std::rename( temp_name.c_str(), manifest_name.c_str() ) != 0 ) {
+        std::remove( temp_name.c_str() );
+        return false;
+    }
+
+    return true;
+}
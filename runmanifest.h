@@ -0,0 +1,99 @@
+#ifndef RUNMANIFEST_H
+#define RUNMANIFEST_H
+
+// C System-Headers
+//
+// C++ System headers
+#include <vector>      //vector
+#include <string>      //string
+#include <map>         //std::map
+#include <cstdint>     //fixed width integers
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+//
+
+/*!
+ * \brief Index of the header of every data file in a data run, kept on disk
+ * next to the data itself.
+ *
+ * Building a manifest only requires reading the header of each data file
+ * ( see FlatFileReader::ReadHeader ), the power spectra are never touched. Once built
+ * the manifest is saved to the data directory as "<sift_term>.manifest" and reused by
+ * later runs, so questions such as "which spectra cover 4.0 - 4.1 GHz?" can be
+ * answered without reading any data files at all.
+ *
+ * Each entry records the size and modification time of its data file. Entries for files that
+ * have changed, or been added, since the manifest was saved are rescanned automatically.
+ */
+class RunManifest {
+
+  public:
+
+    /*!
+     * \brief Header of a single data file, along with where it came from.
+     */
+    struct Entry {
+        std::string file_name; //full path to the data file
+        uint64_t file_size;
+        int64_t file_mtime;
+        std::map<std::string, double> header;
+
+        /*!
+         * \brief Smallest frequency covered by the data file (MHz), identical to
+         * SingleSpectrum::min_freq for the spectrum it contains.
+         */
+        double min_freq() const;
+
+        /*!
+         * \brief Largest frequency covered by the data file (MHz), identical to
+         * SingleSpectrum::max_freq for the spectrum it contains.
+         */
+        double max_freq() const;
+    };
+
+    /*!
+     * \brief Load the manifest for a data run, building or updating it as needed.
+     *
+     * \param dir_name
+     * File path to the directory containing data collected by Electric Tiger
+     *
+     * \param sift_term
+     * Only files containing sift_term in their names are indexed, see FlatFileReader::FlatFileReader
+     *
+     * \param io_depth
+     * The maximum number of headers that will be read from disk at once.
+     */
+    RunManifest( std::string dir_name, std::string sift_term, uint io_depth = 4 );
+    ~RunManifest();
+
+    /*!
+     * \brief Get the full path of every data file whose frequency range overlaps [f_min, f_max].
+     *
+     * Files are returned in the same order as FlatFileReader::EnumerateFiles.
+     * Files whose header does not contain both "actual_center_freq" and "sa_span"
+     * are never returned.
+     */
+    std::vector<std::string> FilesInRange( double f_min, double f_max );
+
+    /*!
+     * \brief Similar to std::vector::at(), get the manifest entry of a single data file.
+     */
+    const Entry& at( uint idx );
+
+    /*!
+     * \brief Similar to std::vector::size(), get the number of indexed data files.
+     */
+    uint size();
+
+  private:
+    std::string manifest_name;
+    std::vector<Entry> entries;
+
+    std::map<std::string, Entry> LoadManifest( std::string dir_name );
+    bool SaveManifest();
+};
+
+#endif // RUNMANIFEST_H
@@ -0,0 +1,242 @@
+// Header for this file
+#include "runwatcher.h"
+// C System-Headers
+#include <sys/inotify.h>  //inotify_init1(), inotify_add_watch()
+#include <poll.h>         //poll()
+#include <sys/stat.h>     //stat()
+#include <unistd.h>       //read(), close()
+#include <errno.h>        //errno
+#include <string.h>       //strerror()
+// C++ System headers
+#include <vector>      //vector
+#include <string>      //string
+#include <iostream>    //cout
+#include <stdexcept>   //std::invalid_argument
+#include <utility>     //std::move, std::make_pair
+#include <chrono>      //steady_clock
+#include <ctime>       //time()
+#include <algorithm>   //std::min
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "flatfileinterface.h"
+#include "singlespectrum.h"
+
+//A file found at startup that is still being written is taken as completed once it has not
+//changed for this many seconds
+const uint settle_seconds = 5;
+
+RunWatcher::RunWatcher( std::string dir_name, std::string sift_term ) {
+
+    //file names are appended to dir_name
+    if( dir_name.empty() || dir_name.back() != '/' ) {
+        dir_name += '/';
+    }
+
+    this->dir_name = dir_name;
+    this->sift_term = sift_term;
+
+    inotify_fd = inotify_init1( IN_CLOEXEC );
+
+    //IN_CLOSE_WRITE- a file has been written and closed
+    //IN_MOVED_TO- a completed file has been renamed into the directory
+    if( inotify_fd < 0 || inotify_add_watch( inotify_fd, dir_name.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO ) < 0 ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nCould not watch directory "+dir_name+" : ";
+        err_mesg += strerror( errno );
+
+        if( inotify_fd >= 0 ) {
+            close( inotify_fd );
+        }
+
+        throw std::invalid_argument(err_mesg);
+    }
+}
+
+RunWatcher::~RunWatcher() {
+    close( inotify_fd );
+}
+
+bool RunWatcher::ReadEvents( uint timeout, std::vector<std::string>& completed_files ) {
+
+    completed_files.clear();
+
+    pollfd watch_fd { inotify_fd, POLLIN, 0 };
+    int poll_timeout = ( timeout == 0 )? -1 : static_cast<int>( timeout*1000 );
+
+    int ready;
+    do {
+        ready = poll( &watch_fd, 1, poll_timeout );
+    } while( ready < 0 && errno == EINTR );
+
+    if( ready < 0 ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nCould not wait for events: ";
+        err_mesg += strerror( errno );
+        throw std::invalid_argument(err_mesg);
+    }
+
+    if( ready == 0 ) {
+        return false;
+    }
+
+    //inotify_event is variable length, the buffer must be suitably aligned for it
+    alignas( inotify_event ) char buffer[ 64*( sizeof( inotify_event ) + NAME_MAX + 1 ) ];
+    ssize_t length = read( inotify_fd, buffer, sizeof( buffer ) );
+
+    for( ssize_t pos = 0 ; pos < length ; ) {
+
+        const inotify_event* event = reinterpret_cast<const inotify_event*>( buffer + pos );
+        pos += sizeof( inotify_event ) + event->len;
+
+        if( event->len == 0 || ( event->mask & IN_ISDIR ) ) {
+            continue;
+        }
+
+        std::string file_name( event->name );
+
+        if( FlatFileReader::IsDataFile( file_name, sift_term ) ) {
+            completed_files.push_back( dir_name + file_name );
+        }
+    }
+
+    return true;
+}
+
+bool RunWatcher::Settled( const std::string& file_name ) {
+
+    struct stat file_stat;
+
+    //a file that has gone is left to fail when it is read
+    if ( stat( file_name.c_str(), &file_stat ) != 0 ) {
+        return true;
+    }
+
+    auto state = std::make_pair( file_stat.st_size, static_cast<int64_t>( file_stat.st_mtim.tv_sec ) );
+    auto last_state = deferred_files.find( file_name );
+
+    //a file seen for the first time only has its modification time to go by
+    bool unchanged = ( last_state == deferred_files.end() || last_state->second == state );
+    bool idle = ( static_cast<int64_t>( time( nullptr ) ) - state.second >= settle_seconds );
+
+    if( unchanged && idle ) {
+        return true;
+    }
+
+    deferred_files[ file_name ] = state;
+    return false;
+}
+
+uint RunWatcher::Watch( Spectrum& spectra, Stage process, Update on_update, uint idle_timeout ) {
+
+    uint num_added = 0;
+
+    //Files completed before the watch was set up will never generate an event.
+    //Files completed since then may be listed here -and- generate an event, hence processed_files.
+    //Files still being written will generate an event once they are closed, but in case they were
+    //closed just before the watch was set up they are also looked at again until they settle.
+    std::vector<std::string> new_files;
+    std::vector<std::string> settled_files;
+
+    for( const auto& file_name : FlatFileReader::EnumerateFiles( dir_name, sift_term ) ) {
+        if( Settled( file_name ) ) {
+            new_files.push_back( file_name );
+        }
+    }
+
+    //Add one file, returns false once watching should stop
+    auto add_file = [&]( const std::string& file_name, bool settled ) {
+
+        deferred_files.erase( file_name );
+
+        //a file taken as complete because it stopped changing has been written again since,
+        //so the spectrum read from it before was incomplete
+        auto stale = settled_spectra.find( file_name );
+        bool replacing = ( !settled && stale != settled_spectra.end() );
+
+        if( processed_files.count( file_name ) > 0 && !replacing ) {
+            return true;
+        }
+
+        try {
+            SingleSpectrum spec( FlatFileReader::FastRead( file_name ) );
+            process( spec, spectra.size() );
+
+            if( replacing ) {
+                std::cout << "Replacing " << file_name << ", it was written again after it was read." << std::endl;
+                spectra -= stale->second;
+                settled_spectra.erase( stale );
+            }
+
+            if( settled ) {
+                settled_spectra.insert( std::make_pair( file_name, spec ) );
+            }
+
+            spectra += std::move( spec );
+        } catch ( const std::exception& e ) {
+            std::cout << "Skipping " << file_name << ": " << e.what() << std::endl;
+            return true;
+        }
+
+        if( !replacing ) {
+            processed_files.insert( file_name );
+            num_added++;
+        }
+
+        return on_update( spectra, file_name );
+    };
+
+    auto last_completed = std::chrono::steady_clock::now();
+
+    while( true ) {
+
+        if( !new_files.empty() || !settled_files.empty() ) {
+            last_completed = std::chrono::steady_clock::now();
+        }
+
+        for( const auto& file_name : new_files ) {
+            if( !add_file( file_name, false ) ) {
+                return num_added;
+            }
+        }
+
+        for( const auto& file_name : settled_files ) {
+            if( !add_file( file_name, true ) ) {
+                return num_added;
+            }
+        }
+
+        uint timeout = idle_timeout;
+
+        if( idle_timeout > 0 ) {
+            std::chrono::duration<double> idle = std::chrono::steady_clock::now() - last_completed;
+
+            if( idle.count() >= static_cast<double>( idle_timeout ) ) {
+                break;
+            }
+
+            timeout = idle_timeout - static_cast<uint>( idle.count() );
+        }
+
+        //wake up in time to look at files that were still being written
+        if( !deferred_files.empty() ) {
+            timeout = ( timeout == 0 )? settle_seconds : std::min( timeout, settle_seconds );
+        }
+
+        ReadEvents( timeout, new_files );
+
+        //copied, since Settled() updates deferred_files
+        auto deferred = deferred_files;
+        settled_files.clear();
+
+        for( const auto& file : deferred ) {
+            if( Settled( file.first ) ) {
+                settled_files.push_back( file.first );
+            }
+        }
+    }
+
+    return num_added;
+}
@@ -0,0 +1,127 @@
+#ifndef RUNWATCHER_H
+#define RUNWATCHER_H
+
+// C System-Headers
+#include <sys/types.h> //off_t
+// C++ System headers
+#include <cstdint>     //int64_t
+#include <vector>      //vector
+#include <string>      //string
+#include <set>         //std::set
+#include <map>         //std::map
+#include <utility>     //std::pair
+#include <functional>  //std::function
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "spectrum.h"
+#include "ingestpipeline.h"
+
+/*!
+ * \brief Object that follows a data directory while Electric Tiger is still taking data,
+ * analysing each data file as soon as it has been completely written.
+ *
+ * The directory is watched using inotify, a file is considered complete once the program
+ * writing it closes it (or once it is renamed into the directory). Each new file is parsed,
+ * run through a user supplied processing stage and added to a Spectrum, after which an update
+ * callback is run, e.g. to rebuild the Grand Spectrum and Limits.
+ *
+ * Earlier spectra are never parsed or filtered again, only the new spectrum is processed
+ * each time a file arrives.
+ *
+ * Files that are already in the directory when Watch() is called are processed first,
+ * in order of file index (see FlatFileReader::EnumerateFiles). Any of them whose size or
+ * modification time is still changing is left until it is closed, or has stopped changing
+ * for a few seconds, so a file still being written is not read truncated. Should such a file
+ * be closed after it stopped changing (its writer stalled), its spectrum is read again and
+ * replaces the one read before.
+ *
+ * A file only counts as processed once its spectrum has been added, so a file that could not
+ * be read is tried again the next time it is closed.
+ */
+class RunWatcher {
+
+  public:
+    /*!
+     * \brief A processing stage, see IngestPipeline::Stage. The second argument is
+     * the number of spectra processed before this one.
+     */
+    typedef IngestPipeline::Stage Stage;
+
+    /*!
+     * \brief Called after each new spectrum has been added to the Spectrum.
+     *
+     * The first argument is the Spectrum holding every spectrum processed so far,
+     * the second is the full path of the file that was just added.
+     * Return false to stop watching.
+     */
+    typedef std::function< bool( Spectrum&, const std::string& ) > Update;
+
+    /*!
+     * \brief Start watching a directory, events are collected from this point on
+     * but no files are read until Watch() is called.
+     *
+     * \param dir_name
+     * File path to the directory of the data run Electric Tiger is writing to, i.e. the directory
+     * holding the data files themselves.
+     *
+     * \param sift_term
+     * Only files containing sift_term in their names will be loaded, see FlatFileReader::FlatFileReader
+     *
+     * \throws std::invalid_argument
+     * Thrown if the directory could not be watched.
+     */
+    RunWatcher( std::string dir_name, std::string sift_term );
+    ~RunWatcher();
+
+    RunWatcher( const RunWatcher& ) = delete;
+    RunWatcher& operator=( const RunWatcher& ) = delete;
+
+    /*!
+     * \brief Process existing data files, then every new data file as it is completed.
+     *
+     * Files that cannot be read or parsed are reported and skipped, so that one bad file
+     * does not end a live analysis. They are tried again if they are written again.
+     *
+     * \param spectra
+     * Spectrum that each processed spectrum will be added to.
+     *
+     * \param process
+     * Processing stage run on each spectrum before it is added to spectra.
+     *
+     * \param on_update
+     * Called after each spectrum is added, watching stops once it returns false.
+     *
+     * \param idle_timeout
+     * Stop watching if no new file is completed for this many seconds, zero means wait forever.
+     *
+     * \return
+     * The number of spectra added to spectra.
+     */
+    uint Watch( Spectrum& spectra, Stage process, Update on_update, uint idle_timeout = 0 );
+
+  private:
+    std::string dir_name;
+    std::string sift_term;
+
+    int inotify_fd = -1;
+    std::set<std::string> processed_files;
+
+    //Files found when Watch() started that were still being written, with the size
+    //and modification time they had when last looked at
+    std::map< std::string, std::pair<off_t, int64_t> > deferred_files;
+
+    //Spectra of deferred files that were taken as completed because they stopped changing,
+    //replaced if the file turns out to be written again
+    std::map< std::string, SingleSpectrum > settled_spectra;
+
+    //Wait for files to be completed, returns false if nothing happened within timeout seconds
+    bool ReadEvents( uint timeout, std::vector<std::string>& completed_files );
+
+    //Check whether file_name has stopped changing, remembering its size and modification time if not
+    bool Settled( const std::string& file_name );
+};
+
+#endif // RUNWATCHER_H
@@ -0,0 +1,55 @@
+#!/bin/bash
+# Simulate Electric Tiger taking data, so that watch mode (see RunWatcher and Watch() in main.cpp)
+# can be tested without the DAQ.
+#
+# The data files of an existing data run are written into a temporary directory one at a time,
+# in order of file index. Each file is written in two halves with a pause in between, just as
+# a slow writer would, so a watcher that picks up files before they are closed reads truncated data.
+#
+# Usage: simulate_run.sh SOURCE_DIR [DELAY] [SIFT_TERM]
+#
+#   SOURCE_DIR  Directory holding the data files of a data run
+#   DELAY       Seconds between files (default 2)
+#   SIFT_TERM   Only files containing SIFT_TERM are written (default SA_F)
+#
+# The temporary directory is printed first, start the analysis with
+#
+#   NouveauAnalysis --watch <that directory>
+#
+# to follow it (see Watch() in main.cpp). Set RUN_DIR to write into a directory of your choosing.
+
+set -e
+
+if [ -z "$1" ] || [ ! -d "$1" ]; then
+    echo "Usage: $0 SOURCE_DIR [DELAY] [SIFT_TERM]" >&2
+    exit 1
+fi
+
+source_dir="$1"
+delay="${2:-2}"
+sift_term="${3:-SA_F}"
+
+run_dir="${RUN_DIR:-$(mktemp -d /tmp/tigerlyzer_run.XXXXXX)}"
+mkdir -p "$run_dir"
+echo "Writing data run to $run_dir/"
+
+# data files in order of file index, skipping caches and manifests made from them
+files=$(ls "$source_dir" | grep -F "$sift_term" | grep -v -e '\.cache$' -e '\.manifest$' -e '\.tmp$' | sort -V)
+
+count=0
+for file in $files; do
+    size=$(stat -c %s "$source_dir/$file")
+    half=$(( size/2 ))
+
+    {
+        head -c "$half" "$source_dir/$file"
+        sleep 0.5
+        tail -c +$(( half + 1 )) "$source_dir/$file"
+    } > "$run_dir/$file"
+
+    count=$(( count + 1 ))
+    echo "Wrote $file ($count)"
+    sleep "$delay"
+done
+
+echo "Done, wrote $count files to $run_dir/"
@@ -28,19 +28,66 @@
 #include "/home/bephillips2/gnuplot-iostream/gnuplot-iostream.h"
 //Project Specific Headers
 #include "physicsfunctions.h"
+#include "flatfileinterface.h"
+#include "spectrumexporter.h"
+#include "spectrumkernels.h"
 
 
-SingleSpectrum::SingleSpectrum(std::string raw_data) {
+//Spectra at least this long are binned by several threads
+const uint parallel_bin_points = 1 << 16;
+
+SingleSpectrum::SingleSpectrum(boost::string_ref raw_data, LoadPolicy policy) {
+
+    if( policy == LoadPolicy::Lazy ) {
+        //Only the header is needed for now, hold on to the rest until it is used
+        FlatFileParser parser( raw_data, true );
+        FillFromHeader( parser.GetHeader() );
+
+        payload_state = Payload::Pending;
+        pending_data = raw_data;
+        pending_points = parser.NumPoints();
+
+        //Power values will be in watts by the time anyone can see them
+        current_units = Units::Watts;
+        return;
+    }
+
     //Load relevent parameters from string
     ParseRawData(raw_data);
+    Decoded( policy );
+}
+
+SingleSpectrum::SingleSpectrum(FlatFileParser& parser, LoadPolicy policy) {
+
+    FillFromHeader( parser.GetHeader() );
+
+    //take ownership of the parsed power list rather than copying it
+    sa_power_list.swap( parser.GetPowerList() );
+    Decoded( policy );
+}
+
+void SingleSpectrum::Decoded( LoadPolicy policy ) {
+
+    //power values have just been decoded, and are still in dBm
+    if( policy == LoadPolicy::Quantized ) {
+        quantize( sa_power_list, quantized_power, quantized_offset, quantized_step );
+
+        payload_state = Payload::Quantized;
+        pending_points = sa_power_list.size();
+        PowerList().swap( sa_power_list );
+
+        //Power values will be in watts by the time anyone can see them
+        current_units = Units::Watts;
+        return;
+    }
 
     //convert from natives units of dBm to absolute power in watts
     dBmToWatts();
 }
 
 SingleSpectrum::SingleSpectrum(uint size) {
-    sa_power_list = std::vector<double> (size, 0.0);
-    uncertainties = std::vector<double> (size, 0.0);
+    sa_power_list = PowerList (size, 0.0);
+    uncertainties = PowerList (size, 0.0);
 }
 
 SingleSpectrum::SingleSpectrum(uint size, double min_freq, double max_freq) {
@@ -48,257 +95,219 @@ SingleSpectrum::SingleSpectrum(uint size, double min_freq, double max_freq) {
     center_frequency = (max_freq - min_freq)/2.0 + min_freq;
     frequency_span = (max_freq - min_freq);
 
-    sa_power_list = std::vector<double> (size, 0.0);
-    uncertainties = std::vector<double> (size, 0.0);
+    sa_power_list = PowerList (size, 0.0);
+    uncertainties = PowerList (size, 0.0);
 }
 
 SingleSpectrum::~SingleSpectrum() {
     sa_power_list.clear();
 }
 
-uint SingleSpectrum::size() {
-    return sa_power_list.size();
+uint SingleSpectrum::size() const {
+    return ( payload_state == Payload::Resident )? sa_power_list.size() : pending_points;
 }
 
-SingleSpectrum &SingleSpectrum::operator*=(double scalar) {
+void SingleSpectrum::Materialize() const {
 
-    for(unsigned int i=0; i<sa_power_list.size(); i++) {
-        sa_power_list[i]*=scalar;
-        uncertainties[i]*=scalar;
+    if( payload_state == Payload::Resident ) {
+        return;
     }
 
-    return *this;
-}
-
-SingleSpectrum &SingleSpectrum::operator+=(double scalar) {
-
-    for(unsigned int i=0; i<sa_power_list.size(); i++) {
-        sa_power_list[i]+=scalar;
+    if( payload_state == Payload::Evicted ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nPower values of this spectrum have been evicted.";
+        throw std::logic_error(err_mesg);
     }
-    return *this;
-}
-
 
-bool operator== (SingleSpectrum& spectra_a, SingleSpectrum& spectra_b) {
+    if( payload_state == Payload::Spilled ) {
+        auto& file = spill_region->file;
 
-    return ( spectra_a.sa_power_list == spectra_b.sa_power_list);
-}
+        sa_power_list.resize( pending_points );
+        uncertainties.resize( spilled_uncertainties );
 
-bool operator!= (SingleSpectrum& spectra_a, SingleSpectrum& spectra_b) {
-
-    return ( spectra_a.sa_power_list != spectra_b.sa_power_list);
-}
+        file->Read( spill_region->offset, sa_power_list.data(), sa_power_list.size() );
+        file->Read( spill_region->offset + sa_power_list.size()*sizeof( spectrum_value ),
+                    uncertainties.data(), uncertainties.size() );
 
-std::ostream& operator << (std::ostream& stream, SingleSpectrum& spectrum) {
-
-    for(unsigned int i=0; i < spectrum.size(); i++) {
-        stream << spectrum.sa_power_list[i]\
-               << ","\
-               << spectrum.uncertainties[i]\
-               << std::endl;
+        payload_state = Payload::Resident;
+        return;
     }
 
-    return stream;
-}
-
-std::ofstream& operator << (std::ofstream& stream, SingleSpectrum& spectrum) {
+    if( payload_state == Payload::Quantized ) {
+        dequantize_dbm_to_watts( quantized_power, quantized_offset, quantized_step, sa_power_list );
 
-    double delta_f = spectrum.max_freq() - spectrum.min_freq();
-    double min_f = spectrum.min_freq();
-    double n = static_cast<double>( spectrum.size() );
-
-    for(unsigned int i=0; i<spectrum.size(); i++) {
-
-        double freq = delta_f*( i / n ) + min_f;
-        stream << freq << "," << spectrum.sa_power_list[i] << std::endl;
+        payload_state = Payload::Resident;
+        QuantizedList().swap( quantized_power );
+        return;
     }
 
-    return stream;
-}
-
-SingleSpectrum operator+ (SingleSpectrum& spectra_a, SingleSpectrum& spectra_b) {
+    //the header was decoded when this spectrum was constructed, only power values are left
+    FlatFileParser parser( pending_data );
 
-    if( spectra_a.size() != spectra_b.size() ) {
-        std::string err_mesg = "Spectra are not the same size ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_a.size());
-        err_mesg += " vs ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_b.size());
-        throw std::length_error(err_mesg);
+    //size() has been reported since then, so it must not change now
+    if( parser.NumPoints() != pending_points ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nDecoded "+boost::lexical_cast<std::string>( parser.NumPoints() )+" power values, but ";
+        err_mesg += boost::lexical_cast<std::string>( pending_points )+" were counted when the spectrum was loaded.";
+        throw std::invalid_argument(err_mesg);
     }
 
-    auto spectra_c = spectra_a;
+    sa_power_list.swap( parser.GetPowerList() );
 
-    std::transform(spectra_c.sa_power_list.begin(),\
-                   spectra_c.sa_power_list.end(),\
-                   spectra_b.sa_power_list.begin(),\
-                   spectra_c.sa_power_list.begin(),\
-                   std::plus<double>());
+    payload_state = Payload::Resident;
+    pending_data = boost::string_ref();
 
-    return spectra_c;
+    //convert from natives units of dBm to absolute power in watts
+    ConvertToWatts( sa_power_list );
 }
 
-SingleSpectrum operator+ (SingleSpectrum& spectra_a, std::vector<double>& spectra_b) {
+void SingleSpectrum::Spill( std::shared_ptr<SpillFile> file, bool modified ) {
 
-    if( spectra_a.size() != spectra_b.size() ) {
-        std::string err_mesg = "Spectra and vector are not the same size ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_a.size());
-        err_mesg += " vs ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_b.size());
-        throw std::length_error(err_mesg);
+    if( payload_state != Payload::Resident ) {
+        return;
     }
 
-    auto spectra_c = spectra_a;
-
-    spectra_c.sa_power_list.resize(spectra_b.size());
+    bool up_to_date = !modified && spill_region && spill_region->file == file;
 
-    std::transform(spectra_c.sa_power_list.begin(),\
-                   spectra_c.sa_power_list.end(),\
-                   spectra_b.begin(),\
-                   spectra_c.sa_power_list.begin(),\
-                   std::plus<double>());
+    if( !up_to_date ) {
+        size_t num_values = sa_power_list.size() + uncertainties.size();
 
-    return spectra_c;
-}
-
-SingleSpectrum operator+ (SingleSpectrum& spectra_a, double scalar) {
+        //copies of this spectrum may still be reading the old region, so it
+        //is only written over if nothing else refers to it
+        bool reuse = spill_region && spill_region.use_count() == 1 &&
+                     spill_region->file == file && spill_region->capacity >= num_values;
 
-    auto spectra_b = spectra_a;
+        if( !reuse ) {
+            //hand back the old region first, so it may be reused for the new one
+            spill_region.reset();
+            spill_region = std::make_shared<SpillRegion>( file, num_values );
+        }
 
-    for(unsigned int i=0; i<spectra_b.sa_power_list.size(); i++) {
-        spectra_b.sa_power_list[i] += scalar;
-        spectra_b.uncertainties[i] += scalar;
+        file->Write( spill_region->offset, sa_power_list.data(), sa_power_list.size() );
+        file->Write( spill_region->offset + sa_power_list.size()*sizeof( spectrum_value ),
+                     uncertainties.data(), uncertainties.size() );
     }
 
-    return spectra_b;
-}
+    pending_points = sa_power_list.size();
+    spilled_uncertainties = uncertainties.size();
+    payload_state = Payload::Spilled;
 
-SingleSpectrum operator- (SingleSpectrum& spectra_a, SingleSpectrum& spectra_b) {
+    PowerList().swap( sa_power_list );
+    PowerList().swap( uncertainties );
+}
 
-    if( spectra_a.size() != spectra_b.size() ) {
-        std::string err_mesg = "Spectra are not the same size ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_a.size());
-        err_mesg += " vs ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_b.size());
-        throw std::length_error(err_mesg);
-    }
+size_t SingleSpectrum::ResidentBytes() const {
+    return ( sa_power_list.capacity() + uncertainties.capacity() )*sizeof( spectrum_value ) +
+           quantized_power.capacity()*sizeof( uint16_t );
+}
 
-    auto spectra_c = spectra_a;
+void SingleSpectrum::Evict() {
 
-    std::transform(spectra_c.sa_power_list.begin(),\
-                   spectra_c.sa_power_list.end(),\
-                   spectra_b.sa_power_list.begin(),\
-                   spectra_c.sa_power_list.begin(),\
-                   std::minus<double>());
+    pending_points = size();
+    pending_data = boost::string_ref();
+    spill_region.reset();
+    payload_state = Payload::Evicted;
 
-    return spectra_c;
+    QuantizedList().swap( quantized_power );
+    PowerList().swap( sa_power_list );
+    PowerList().swap( uncertainties );
 }
 
-SingleSpectrum operator- (SingleSpectrum& spectra_a, std::vector<double>& spectra_b) {
-
-    if( spectra_a.size() != spectra_b.size() ) {
-        std::string err_mesg = "Spectra and vector are not the same size ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_a.size());
-        err_mesg += " vs ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_b.size());
-        throw std::length_error(err_mesg);
-    }
-
-    auto spectra_c = spectra_a;
+SingleSpectrum &SingleSpectrum::operator*=(double scalar) {
+    Materialize();
 
-    std::transform(spectra_c.sa_power_list.begin(),\
-                   spectra_c.sa_power_list.end(),\
-                   spectra_b.begin(),\
-                   spectra_c.sa_power_list.begin(),\
-                   std::minus<double>());
+    scale( sa_power_list, scalar );
+    scale( uncertainties, scalar );
 
-    return spectra_c;
+    return *this;
 }
 
-SingleSpectrum operator- (SingleSpectrum& spectra_a, double scalar) {
+SingleSpectrum &SingleSpectrum::operator+=(double scalar) {
+    Materialize();
 
-    auto spectra_b = spectra_a;
+    shift( sa_power_list, scalar );
 
-    for(unsigned int i=0; i<spectra_b.sa_power_list.size(); i++) {
-        spectra_b.sa_power_list[i] -= scalar;
-        spectra_b.uncertainties[i] -= scalar;
-    }
-
-    return spectra_b;
+    return *this;
 }
 
-SingleSpectrum operator* (SingleSpectrum& spectra_a, SingleSpectrum& spectra_b) {
 
-    if( spectra_a.size() != spectra_b.size() ) {
-        std::string err_mesg = "Spectra are not the same size ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_a.size());
-        err_mesg += " vs ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_b.size());
-        throw std::length_error(err_mesg);
-    }
+bool operator== (const SingleSpectrum& spectra_a, const SingleSpectrum& spectra_b) {
+    spectra_a.Materialize();
+    spectra_b.Materialize();
 
-    auto spectra_c = spectra_a;
+    return ( spectra_a.sa_power_list == spectra_b.sa_power_list);
+}
 
-    for(unsigned int i=0; i<spectra_a.size(); i++) {
-        spectra_c.sa_power_list[i] =\
-                                    spectra_a.sa_power_list[i] *\
-                                    spectra_b.sa_power_list[i];
-    }
+bool operator!= (const SingleSpectrum& spectra_a, const SingleSpectrum& spectra_b) {
+    spectra_a.Materialize();
+    spectra_b.Materialize();
 
-    return spectra_c;
+    return ( spectra_a.sa_power_list != spectra_b.sa_power_list);
 }
 
-SingleSpectrum operator* (SingleSpectrum& spectra_a, std::vector<double>& spectra_b) {
+std::ostream& operator << (std::ostream& stream, const SingleSpectrum& spectrum) {
+    spectrum.Materialize();
 
-    if( spectra_a.size() != spectra_b.size() ) {
-        std::string err_mesg = __FUNCTION__;
-        err_mesg += "\nSpectra and vector are not the same size ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_a.size());
-        err_mesg += " vs ";
-        err_mesg += boost::lexical_cast<std::string> (spectra_b.size());
-        throw std::length_error(err_mesg);
+    for(unsigned int i=0; i < spectrum.size(); i++) {
+        stream << spectrum.sa_power_list[i]\
+               << ","\
+               << spectrum.uncertainties[i]\
+               << std::endl;
     }
 
-    auto spectra_c = spectra_a;
+    return stream;
+}
 
-    for(unsigned int i=0; i<spectra_a.size(); i++) {
-        spectra_c.sa_power_list[i] =\
-                                    spectra_a.sa_power_list[i] *\
-                                    spectra_b[i];
-    }
+std::ofstream& operator << (std::ofstream& stream, const SingleSpectrum& spectrum) {
+    spectrum.Materialize();
 
-    return spectra_c;
-}
+    double delta_f = spectrum.max_freq() - spectrum.min_freq();
+    double min_f = spectrum.min_freq();
+    double n = static_cast<double>( spectrum.size() );
 
-SingleSpectrum operator* (SingleSpectrum& spectra_a, double scalar) {
+    //rows are formatted into one large buffer, rather than flushing the stream every line
+    SpectrumExporter exporter( stream );
 
-    auto spectra_b = spectra_a;
+    for(unsigned int i=0; i<spectrum.size(); i++) {
 
-    for(unsigned int i=0; i<spectra_b.sa_power_list.size(); i++) {
-        spectra_b.sa_power_list[i] *= scalar;
-        spectra_b.uncertainties[i] *= scalar;
+        double freq = delta_f*( i / n ) + min_f;
+        exporter.write( freq, spectrum.sa_power_list[i] );
     }
 
-    return spectra_b;
+    exporter.flush();
+
+    return stream;
 }
 
 void SingleSpectrum::dBmToWatts() {
+    Materialize();
     if( current_units != Units::dBm ) {
         std::string err_mesg = __FUNCTION__;
         err_mesg += "\nSpectra must be in units of dBm.";
         throw std::invalid_argument(err_mesg);
     }
 
-    for (auto& power : sa_power_list ) {
-        power = dbm_to_watts(power);
-    }
+    ConvertToWatts( sa_power_list );
 
     current_units = Units::Watts;
 }
 
+void SingleSpectrum::ConvertToWatts( PowerList& power_list ) {
+
+    spectrum_value* power = power_list.data();
+    const uint n = power_list.size();
+
+    #pragma omp simd aligned( power : power_list_alignment )
+    for( uint i = 0; i < n; i++ ) {
+        power[i] = dbm_to_watts( power[i] );
+    }
+}
+
 /*!
  * \brief Convert from usings of watts to units of watts above noise (i.e. excess power)
  */
 void SingleSpectrum::WattsToExcessPower() {
+    Materialize();
 
     if( current_units != Units::Watts ) {
         std::string err_mesg = __FUNCTION__;
@@ -313,17 +322,61 @@ void SingleSpectrum::WattsToExcessPower() {
     //them inside a member function
     double mean_val = mean();
 
-    for(uint i=0; i<sa_power_list.size(); i++) {
-        sa_power_list.at(i) *= ( noise_power/ mean_val );
+    scale_shift( sa_power_list, noise_power/ mean_val, -noise_power );
+
+    PopulateUncertainties( 32 );
+
+    current_units = Units::ExcessPower;
+}
+
+void SingleSpectrum::ConvertToAxionPower() {
+    Materialize();
+
+    if( current_units == Units::dBm ) {
+        dBmToWatts();
     }
 
-    for(uint i=0; i<sa_power_list.size(); i++) {
-        sa_power_list.at(i) += ( -noise_power );
+    if( current_units != Units::Watts ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nSpectra must be in units of dBm or Watts.";
+        throw std::invalid_argument(err_mesg);
     }
 
-    PopulateUncertainties( 32 );
+    //Excess power needs the mean of the whole spectrum, so it takes one pass to find it
+    //and a second pass does everything else
+    double noise_power = power_per_bin( noise_temperature, bin_width() );
+    double mean_val = mean();
 
-    current_units = Units::ExcessPower;
+    double factor = noise_power/ mean_val;
+    double offset = -noise_power;
+    double uniform_uncertainty = UniformUncertainty( 32 );
+
+    const uint n = size();
+    uncertainties.resize( n );
+
+    spectrum_value* power = sa_power_list.data();
+    spectrum_value* uncertainty = uncertainties.data();
+
+    //same arithmetic as bin_mid_freq(i)
+    double freq_start = center_frequency - 0.5*frequency_span;
+    double half_width = 0.5*bin_width();
+
+    //Each step is applied exactly as WattsToExcessPower(), LorentzianWeight() and
+    //KSVZWeight() apply it, so results are identical to calling them in turn
+    #pragma omp simd aligned( power, uncertainty : power_list_alignment )
+    for( uint i = 0; i < n; i++ ) {
+
+        double frequency = ( freq_start + static_cast<double>(i)*frequency_span/static_cast<double>(n) ) + half_width;
+        double lorentzian_weight = lorentzian( center_frequency, frequency, Q );
+        double ksvz_weight = max_ksvz_power( effective_volume, b_field, frequency, Q );
+
+        double excess_power = power[i]*factor + offset;
+
+        power[i] = excess_power/ lorentzian_weight/ ksvz_weight;
+        uncertainty[i] = uniform_uncertainty/ lorentzian_weight/ ksvz_weight;
+    }
+
+    current_units = Units::AxionPower;
 }
 
 
@@ -337,23 +390,41 @@ void SingleSpectrum::WattsToExcessPower() {
 //}
 //double lorentzian (double f0, double omega, double Q )
 void SingleSpectrum::LorentzianWeight() {
+    Materialize();
     if( current_units != Units::ExcessPower ) {
         std::string err_mesg = __FUNCTION__;
         err_mesg += "\nSpectra must be in units of excess power.";
         throw std::invalid_argument(err_mesg);
     }
 
-    for(uint i=0; i < size(); i++) {
+    if( uncertainties.size() != size() ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nUncertainties have not been populated.";
+        throw std::out_of_range(err_mesg);
+    }
 
-        double frequency = bin_mid_freq(i);
+    spectrum_value* power = sa_power_list.data();
+    spectrum_value* uncertainty = uncertainties.data();
+    const uint n = size();
 
-        sa_power_list.at(i) /= lorentzian( center_frequency, frequency, Q );
-        uncertainties.at(i) /= lorentzian( center_frequency, frequency, Q );
+    //same arithmetic as bin_mid_freq(i)
+    double freq_start = center_frequency - 0.5*frequency_span;
+    double half_width = 0.5*bin_width();
+
+    #pragma omp simd aligned( power, uncertainty : power_list_alignment )
+    for( uint i = 0; i < n; i++ ) {
+
+        double frequency = ( freq_start + static_cast<double>(i)*frequency_span/static_cast<double>(n) ) + half_width;
+        double weight = lorentzian( center_frequency, frequency, Q );
+
+        power[i] /= weight;
+        uncertainty[i] /= weight;
     }
 
 }
 
 void SingleSpectrum::KSVZWeight() {
+    Materialize();
 
     if( current_units != Units::ExcessPower ) {
         std::string err_mesg = __FUNCTION__;
@@ -361,19 +432,35 @@ void SingleSpectrum::KSVZWeight() {
         throw std::invalid_argument(err_mesg);
     }
 
-    for(uint i=0; i < size(); i++) {
+    if( uncertainties.size() != size() ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nUncertainties have not been populated.";
+        throw std::out_of_range(err_mesg);
+    }
 
-        double frequency = bin_mid_freq(i);
+    spectrum_value* power = sa_power_list.data();
+    spectrum_value* uncertainty = uncertainties.data();
+    const uint n = size();
 
-        sa_power_list.at(i) /= max_ksvz_power( effective_volume, b_field, frequency, Q );
-        uncertainties.at(i) /= max_ksvz_power( effective_volume, b_field, frequency, Q );
+    //same arithmetic as bin_mid_freq(i)
+    double freq_start = center_frequency - 0.5*frequency_span;
+    double half_width = 0.5*bin_width();
+
+    #pragma omp simd aligned( power, uncertainty : power_list_alignment )
+    for( uint i = 0; i < n; i++ ) {
+
+        double frequency = ( freq_start + static_cast<double>(i)*frequency_span/static_cast<double>(n) ) + half_width;
+        double weight = max_ksvz_power( effective_volume, b_field, frequency, Q );
+
+        power[i] /= weight;
+        uncertainty[i] /= weight;
     }
 
     current_units = Units::AxionPower;
 
 }
 
-std::string SingleSpectrum::units() {
+std::string SingleSpectrum::units() const {
     switch( current_units ) {
     case Units::dBm:
         return "dBm";
@@ -396,16 +483,21 @@ std::string SingleSpectrum::units() {
 }
 
 void SingleSpectrum::PopulateUncertainties( uint rebin_size ) {
+    Materialize();
 
     uncertainties.clear();
 
-    double noise_power = power_per_bin( noise_temperature, bin_width() );
-    double uniform_uncertainty = noise_power / sqrt( number_of_averages*rebin_size );
+    uncertainties = PowerList ( size() , UniformUncertainty( rebin_size ));
+}
+
+double SingleSpectrum::UniformUncertainty( uint rebin_size ) const {
 
-    uncertainties = std::vector<double> ( size() , uniform_uncertainty);
+    double noise_power = power_per_bin( noise_temperature, bin_width() );
+    return noise_power / sqrt( number_of_averages*rebin_size );
 }
 
-void SingleSpectrum::InitialBin ( uint bin_points ) {
+void SingleSpectrum::InitialBin ( uint bin_points, double overlap ) {
+    Materialize();
 
     if( current_units != Units::Watts ) {
         std::string err_mesg = "Spectra needs to be in Watts before initial binning.";
@@ -414,40 +506,81 @@ void SingleSpectrum::InitialBin ( uint bin_points ) {
 
     // choose bin size (approximate)
     // bin_window ~ # points / (0.5 * axion width / (frequency span / # points))
-    // bins overlap in half bin size increments
-    uint bin_window = static_cast<uint>(bin_points / 2);
+    // consecutive bins start step points apart, so they share bin_points - step points
+    if( bin_points == 0 || !( overlap >= 0.0 && overlap < 1.0 ) ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nBins must hold at least one point and overlap by a fraction in [0,1).";
+        throw std::invalid_argument(err_mesg);
+    }
+
+    // an overlap close to 1 can round to the whole bin, bins then still start a point apart
+    uint shared_points = static_cast<uint>( std::round( bin_points*overlap ) );
+    uint step = ( shared_points < bin_points )? bin_points - shared_points : 1;
+
+    // Every window is made of whole blocks of block_points, each block is summed once
+    // and its sum shared by every window that covers it
+    uint block_points = bin_points;
+    for( uint remainder = step; remainder != 0; ) {
+        uint next = block_points % remainder;
+        block_points = remainder;
+        remainder = next;
+    }
 
-    double prev_sum = 0; // sum of previous FFT points
-    double curr_sum = 0; // running sum of current FFT points
+    uint blocks_per_bin = bin_points/ block_points;
+    uint blocks_per_step = step/ block_points;
+    uint num_blocks = size()/ block_points;
+    uint num_bins = ( num_blocks >= blocks_per_bin )? ( num_blocks - blocks_per_bin )/blocks_per_step + 1 : 0;
 
-    std::vector<double> rebinned_power_list;
-    std::vector<double> rebinned_uncertainties;
+    // Reused from one spectrum to the next, so binning a run allocates no scratch space
+    static thread_local std::vector<double> block_scratch;
+    block_scratch.resize( num_blocks );
 
-    for ( uint fft_i = 0 ; fft_i < size() ; fft_i ++ ) {
-        curr_sum += sa_power_list[fft_i];
+    //each OpenMP thread has its own thread_local, so the threads share the caller's through a pointer
+    double* block_sums = block_scratch.data();
 
-        if ((fft_i % bin_window) == bin_window - 1) {
-            // average over all the points in the current and previous sums
-            if (fft_i != bin_window - 1) {
-                double new_power = (curr_sum + prev_sum) / (bin_window*2);
+    const spectrum_value* power = sa_power_list.data();
+    bool run_parallel = ( size() >= parallel_bin_points );
 
-                rebinned_power_list.push_back(new_power);
-                rebinned_uncertainties.push_back(new_power);
-            }
-            prev_sum = curr_sum;
-            curr_sum = 0;
+    #pragma omp parallel for if( run_parallel )
+    for( uint m = 0; m < num_blocks; m++ ) {
+
+        const spectrum_value* block = power + static_cast<size_t>( m )*block_points;
+        double block_sum = 0.0;
+
+        for( uint k = 0; k < block_points; k++ ) {
+            block_sum += block[k];
         }
+
+        block_sums[m] = block_sum;
     }
 
-    sa_power_list = rebinned_power_list;
-    uncertainties = rebinned_uncertainties;
+    PowerList binned_power_list( num_bins );
+    double points_per_bin = static_cast<double>( bin_points );
+
+    #pragma omp parallel for if( run_parallel )
+    for( uint j = 0; j < num_bins; j++ ) {
+
+        const double* first_block = block_sums + static_cast<size_t>( j )*blocks_per_step;
+        double bin_sum = 0.0;
+
+        for( uint q = 0; q < blocks_per_bin; q++ ) {
+            bin_sum += first_block[q];
+        }
+
+        binned_power_list[j] = bin_sum/ points_per_bin;
+    }
+
+    //releases the memory held by the unbinned spectrum
+    sa_power_list.swap( binned_power_list );
+
+    PopulateUncertainties( bin_points );
 }
 
-double SingleSpectrum::bin_width() {
+double SingleSpectrum::bin_width() const {
     return frequency_span/static_cast<double>(size());
 }
 
-double SingleSpectrum::bin_start_freq(uint idx) {
+double SingleSpectrum::bin_start_freq(uint idx) const {
     double freq_start = center_frequency - 0.5*frequency_span;
     double dub_idx = static_cast<double>(idx);
     double dub_size = static_cast<double>( size() );
@@ -455,7 +588,13 @@ double SingleSpectrum::bin_start_freq(uint idx) {
     return freq_start+dub_idx*frequency_span/dub_size;
 }
 
-uint SingleSpectrum::bin_at_frequency(double frequency) {
+uint SingleSpectrum::bin_at_frequency(double frequency) const {
+
+    if( size() == 0 ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nSpectrum has no bins.";
+        throw std::out_of_range(err_mesg);
+    }
 
     double min_freq = center_frequency - frequency_span/2.0;
     double max_freq = center_frequency + frequency_span/2.0;
@@ -473,10 +612,12 @@ uint SingleSpectrum::bin_at_frequency(double frequency) {
     double bin_number = (frequency - min_freq)/frequency_span;
     bin_number *= static_cast<double>(size());
     bin_number = floor(bin_number);
-    return static_cast<uint>( bin_number );
+
+    //frequency == max_freq belongs to the last bin, not one past it
+    return std::min( static_cast<uint>( bin_number ), size() - 1 );
 }
 
-double SingleSpectrum::bin_mid_freq(uint idx) {
+double SingleSpectrum::bin_mid_freq(uint idx) const {
 
     return bin_start_freq( idx )+0.5*bin_width();
 }
@@ -486,39 +627,50 @@ double SingleSpectrum::bin_mid_freq(uint idx) {
 // power and uncertainty
 void SingleSpectrum::rebin( uint points_per_bin ) {
 
-//    uint new_size = static_cast<uint>( floor( size()/ points_per_bin ) );
+    auto binned = rebinned( points_per_bin );
 
-    std::vector<double> nu_power_list;
-    std::vector<double> nu_uncertainties;
-
-    double min_power= *std::min_element(sa_power_list.begin(), sa_power_list.end());
-    double min_uncertainty = *std::min_element(uncertainties.begin(), uncertainties.end());
+    sa_power_list.swap( binned.sa_power_list );
+    uncertainties.swap( binned.uncertainties );
+    center_frequency = binned.center_frequency;
+    frequency_span = binned.frequency_span;
+}
 
-    double highest_power = min_power;
-    double highest_uncertainty = min_uncertainty;
+SingleSpectrum SingleSpectrum::rebinned( uint points_per_bin ) const {
+    Materialize();
 
-    for ( uint i = 0 ; i < size() ; i ++ ) {
-        highest_power = std::max(highest_power, sa_power_list[i]);
-        highest_uncertainty = std::max(highest_uncertainty, uncertainties[i]);
+    if( points_per_bin == 0 ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nBins must hold at least one point.";
+        throw std::invalid_argument(err_mesg);
+    }
 
-        if ((i % points_per_bin) == points_per_bin - 1) {
+    SingleSpectrum binned( 0u );
+    binned.CopyHeader( *this );
 
-            nu_power_list.push_back( highest_power );
-            nu_uncertainties.push_back( highest_uncertainty );
+    max_rebin( sa_power_list, points_per_bin, binned.sa_power_list );
 
-            highest_power = min_power;
-            highest_uncertainty = min_uncertainty;
-        }
+    if( uncertainties.size() == size() ) {
+        max_rebin( uncertainties, points_per_bin, binned.uncertainties );
     }
 
-    sa_power_list.clear();
-    uncertainties.clear();
+    binned.ShrinkSpan( binned.sa_power_list.size()*points_per_bin, size() );
 
-    sa_power_list = nu_power_list;
-    uncertainties = nu_uncertainties;
+    return binned;
+}
+
+void SingleSpectrum::ShrinkSpan( uint points_kept, uint num_points ) {
+
+    //points dropped from the end no longer belong to the span
+    if( points_kept != num_points ) {
+        double freq_start = center_frequency - 0.5*frequency_span;
+
+        frequency_span = frequency_span*static_cast<double>( points_kept )/static_cast<double>( num_points );
+        center_frequency = freq_start + 0.5*frequency_span;
+    }
 }
 
 void SingleSpectrum::chop_bins( uint start_chop, uint end_chop ) {
+    Materialize();
 
     uint distance = sa_power_list.size() - end_chop;
 
@@ -527,19 +679,15 @@ void SingleSpectrum::chop_bins( uint start_chop, uint end_chop ) {
     auto power_start = sa_power_list.begin() + start_chop;
     auto power_stop = sa_power_list.begin() + distance;
 
-    sa_power_list = std::vector<double> (power_start, power_stop);
+    sa_power_list = PowerList (power_start, power_stop);
 
     auto uncertainty_start = uncertainties.begin() + start_chop;
     auto uncertainty_stop = uncertainties.begin() + distance;
 
-    uncertainties = std::vector<double> (uncertainty_start, uncertainty_stop);
+    uncertainties = PowerList (uncertainty_start, uncertainty_stop);
 
 }
 
-uint SingleSpectrum::num_lines(std::string raw_data) {
-    return std::count(raw_data.begin(), raw_data.end(), '\n');
-}
-
 template <typename T>
 bool inline check_map ( std::map<std::string, T> check_map , std::vector<std::string> check_keys ) {
 
@@ -555,6 +703,21 @@ bool inline check_map ( std::map<std::string, T> check_map , std::vector<std::st
     return true;
 }
 
+void SingleSpectrum::CopyHeader(const SingleSpectrum& other) {
+
+    current_units = other.current_units;
+
+    center_frequency = other.center_frequency;
+    frequency_span = other.frequency_span;
+    effective_volume = other.effective_volume;
+    noise_temperature = other.noise_temperature;
+    Q = other.Q;
+    b_field = other.b_field;
+
+    number_of_averages = other.number_of_averages;
+    fft_points = other.fft_points;
+}
+
 void SingleSpectrum::FillFromHeader(std::map<std::string, double> header) {
     std::vector<std::string> search_terms = {"sa_span",
                                              "fft_length",
@@ -584,91 +747,37 @@ void SingleSpectrum::FillFromHeader(std::map<std::string, double> header) {
     b_field = header["bfield"];
 }
 
-void SingleSpectrum::ParseRawData(std::string raw_data) {
-    uint lines = num_lines(raw_data);
-    sa_power_list.reserve( lines );
-
-    std::istringstream data_stream(raw_data);
-
-    std::map<std::string, double> header;
-
-    for (uint i = 0; i < 11; i++) {
-        std::string input;
-        std::getline(data_stream, input);
-
-        std::vector<std::string> strs;
-        boost::split(strs, input, boost::is_any_of(";"));
-        if (strs.size() >= 2) {
-            std::string name = strs.at(0);
-            double val = boost::lexical_cast<double>(strs.at(1));
-
-            header[name] = val;
-        }
-    }
-
-    FillFromHeader( header );
-
-    for (uint i = 12; i < lines; i++) {
+void SingleSpectrum::ParseRawData(boost::string_ref raw_data) {
 
-        std::string input;
-        std::getline(data_stream, input);
-        double val = boost::lexical_cast<double>(input);
+    FlatFileParser parser( raw_data );
 
-        sa_power_list.push_back(val);
-
-    }
+    FillFromHeader( parser.GetHeader() );
 
+    //take ownership of the parsed power list rather than copying it
+    sa_power_list.swap( parser.GetPowerList() );
 }
 
-double SingleSpectrum::min_freq() {
+double SingleSpectrum::min_freq() const {
     return ( center_frequency - 0.5*frequency_span);
 }
 
-double SingleSpectrum::max_freq() {
+double SingleSpectrum::max_freq() const {
     return ( center_frequency + 0.5*frequency_span);
 }
 
-double SingleSpectrum::sum(std::vector<double>& data_list, double exponent) {
-
-    double tot = 0;
-
-    for ( uint i = 0 ; i < data_list.size(); i ++) {
-        tot += pow( data_list[i], exponent );
-    }
-
-    return tot;
+SampleStatistics SingleSpectrum::statistics() const {
+    Materialize();
+    return ::statistics( sa_power_list.data(), sa_power_list.size() );
 }
 
-double SingleSpectrum::mean(std::vector<double>& data_list) {
-    //compute mean value of data set
-    double sum_x=sum(data_list,1.0);
-    double n=data_list.size();
-    return sum_x/n;
-}
-
-double SingleSpectrum::mean() {
-    return mean(sa_power_list);
-}
-
-double SingleSpectrum::std_dev(std::vector<double> &data_list) {
-
-    //compute mean value of data set
-    double sum_x=sum(data_list,1.0);
-    double n=data_list.size();
-    double mean = sum_x/n;
-
-    //compute variance taking into account Bessel's correction i.e. n/(n-1)
-    double sum_x2=sum(data_list,2.0);
-    double sigma_sqr=sum_x2/(n-1.0)-n/(n-1.0)*pow(mean,2.0);
-
-    //return square root of variance
-    return sqrt(sigma_sqr);
+double SingleSpectrum::mean() const {
+    return statistics().mean();
 }
 
-double SingleSpectrum::std_dev() {
-    return std_dev(sa_power_list);
+double SingleSpectrum::std_dev() const {
+    return statistics().std_dev();
 }
 
-double SingleSpectrum::norm() {
-    return sqrt(sum(sa_power_list,2.0));
+double SingleSpectrum::norm() const {
+    return statistics().norm();
 }
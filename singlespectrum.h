@@ -8,13 +8,37 @@
 #include <string>      //string
 #include <fstream>     //iss* ofstream
 #include <iostream>    //cout
+#include <memory>      //std::shared_ptr
+#include <cmath>       //sqrt
 // Boost Headers
-//
+#include <boost/utility/string_ref.hpp>  //string_ref
 // Miscellaneous Headers
 //
 //Project Specific Headers
 #include "spectrum.h"
+#include "spillfile.h"
+#include "alignedallocator.h"
+#include "spectrumview.h"
+#include "spectrumexpression.h"
+#include "spectrumstatistics.h"
+
+/*!
+ * \brief When a SingleSpectrum built from raw data should decode its power values.
+ *
+ * Eager - The header and power values are decoded immediately.\n
+ * Lazy - Only the header is decoded immediately, so that min_freq(), max_freq(), bin_width(),
+ * size() etc. are available right away. Power values are decoded (and converted to Watts)
+ * the first time any operation needs them, which throws std::invalid_argument should a line
+ * not decode, rather than changing size().\n
+ * Quantized - The header and power values are decoded immediately, but power values are kept
+ * in dBm as 16 bit fixed point (a quarter of the memory of doubles) and only converted to Watts
+ * the first time any operation needs them. Nothing refers to the raw data afterwards. Values are
+ * rounded to 1/65535th of the spectrum's range in dBm, which for a typical 20 dB range is
+ * about 0.0002 dB or 0.005% in Watts.
+ */
+enum class LoadPolicy {Eager, Lazy, Quantized};
 
+class FlatFileParser;
 
 /*!
  * \brief Class to hold a single power spectrum and its associated parameters, such
@@ -22,7 +46,7 @@
  *
  * Class is designed to 'look and feel' like a \f$ \mathcal{R}^n \f$ vector.
  * Spectra allows scalar multiplication and addition, along with 'vector'
- * multiplication and addition.
+ * multiplication and addition. Arithmetic is evaluated lazily, see spectrumexpression.h.
  *
  * Further each SingleSpectrum tracks its own uncertainties and current units.
  */
@@ -84,9 +108,26 @@ class SingleSpectrum {
      * Thrown if the header is missing certain keys or is formatted incorrectly.
      *
      * \param raw_data
-     * A std::string containing the -entire- contents of a data file.
+     * A std::string, or a read-only view (see FlatFileReader::view), containing the -entire-
+     * contents of a data file. Data is parsed directly from the view, no copy of it is made.
+     *
+     * \param policy
+     * Whether power values should be decoded now or on first use, see LoadPolicy. Note that a
+     * lazily loaded spectrum keeps hold of raw_data, so whatever raw_data points to (e.g. a
+     * FlatFileReader) must outlive it or at least last until the power values are decoded.
+     */
+    SingleSpectrum(boost::string_ref raw_data, LoadPolicy policy = LoadPolicy::Eager);
+
+    /*!
+     * \brief Construct a SingleSpectrum from a data file that has already been parsed,
+     * e.g. by FlatFileReader::CachedRead(), taking its header and power values from parser.
+     *
+     * Power values have already been decoded, so LoadPolicy::Lazy is the same as Eager here.
+     *
+     * \throws std::invalid_argument
+     * Thrown if the header is missing certain keys, see SingleSpectrum::SingleSpectrum.
      */
-    SingleSpectrum(std::string raw_data);
+    SingleSpectrum(FlatFileParser& parser, LoadPolicy policy = LoadPolicy::Eager);
     /*!
      * \brief Construct a blank ( all power values and uncertainties = 0 ) SingleSpectrum
      * with a particular number of enteries.
@@ -113,13 +154,41 @@ class SingleSpectrum {
      * The maximum frequency of the spectrum in MHz.
      */
     SingleSpectrum(uint size, double min_freq, double max_freq);
+
+    /*!
+     * \brief Evaluate an arithmetic expression of spectra, vectors and scalars in a single pass,
+     * see spectrumexpression.h.
+     *
+     * Header information is copied from the left-most spectrum in the expression.
+     */
+    template <typename E>
+    SingleSpectrum(const SpectrumExpression<E>& expression);
     ~SingleSpectrum();
 
+    SingleSpectrum(const SingleSpectrum&) = default;
+    SingleSpectrum& operator=(const SingleSpectrum&) = default;
+
+    /*!
+     * \brief Moving a spectrum hands over its power values and uncertainties without copying them.
+     */
+    SingleSpectrum(SingleSpectrum&&) = default;
+    SingleSpectrum& operator=(SingleSpectrum&&) = default;
+
+    /*!
+     * \brief Evaluate an arithmetic expression of spectra, vectors and scalars in a single pass,
+     * see spectrumexpression.h.
+     *
+     * The expression may refer to this spectrum, e.g. a = a*b + c is evaluated element by element
+     * without a temporary copy of a.
+     */
+    template <typename E>
+    SingleSpectrum& operator=(const SpectrumExpression<E>& expression);
+
     SingleSpectrum &operator*=(double scalar);
     SingleSpectrum &operator+=(double scalar);
 
-    friend bool operator== (SingleSpectrum& spectra_a, SingleSpectrum& spectra_b);
-    friend bool operator!= (SingleSpectrum& spectra_a, SingleSpectrum& spectra_b);
+    friend bool operator== (const SingleSpectrum& spectra_a, const SingleSpectrum& spectra_b);
+    friend bool operator!= (const SingleSpectrum& spectra_a, const SingleSpectrum& spectra_b);
 
     /*!
      * \brief Operator for printing spectrum contents to std::cout or similar
@@ -129,45 +198,99 @@ class SingleSpectrum {
      * \param spectrum to be printed
      * \return new stream object
      */
-    friend std::ostream& operator<< (std::ostream& stream, SingleSpectrum& spectrum);
+    friend std::ostream& operator<< (std::ostream& stream, const SingleSpectrum& spectrum);
     /*!
      * \brief Operator for saving spectra to files
      * Unlike the ostream version, both the header and power data are accessed.
+     * Each line holds "frequency,power", written with as many digits as needed to read the
+     * values back exactly (see format_double) rather than the precision set on the stream.
      *
      * \param stream object
      * \param spectrum to be saved
      * \return new stream object
      */
-    friend std::ofstream& operator<< (std::ofstream& stream, SingleSpectrum& spectrum);
-
-    friend SingleSpectrum operator* (SingleSpectrum& spectra_a, SingleSpectrum& spectra_b);
-    friend SingleSpectrum operator+ (SingleSpectrum& spectra_a, SingleSpectrum& spectra_b);
-    friend SingleSpectrum operator- (SingleSpectrum& spectra_a, SingleSpectrum& spectra_b);
+    friend std::ofstream& operator<< (std::ofstream& stream, const SingleSpectrum& spectrum);
 
-    friend SingleSpectrum operator* (SingleSpectrum& spectra_a, std::vector<double>& spectra_b);
-    friend SingleSpectrum operator+ (SingleSpectrum& spectra_a, std::vector<double>& spectra_b);
-    friend SingleSpectrum operator- (SingleSpectrum& spectra_a, std::vector<double>& spectra_b);
-    friend SingleSpectrum operator* (SingleSpectrum& spectra_a, double scalar);
-    friend SingleSpectrum operator+ (SingleSpectrum& spectra_a, double scalar);
-    friend SingleSpectrum operator- (SingleSpectrum& spectra_a, double scalar);
+    friend class SpectrumView;
+    friend class SpectrumPyramid;
 
-    friend void plot ( SingleSpectrum& spec, std::string plot_title, std::string save_file_path );
-    friend void plot ( SingleSpectrum& spec, uint num_plot_points, std::string plot_title, std::string save_file_path );
+    friend void plot ( const SingleSpectrum& spec, std::string plot_title, std::string save_file_path );
+    friend void plot ( const SingleSpectrum& spec, uint num_plot_points, std::string plot_title, std::string save_file_path );
 
     friend void GaussianFilter ( SingleSpectrum& spec, uint radius );
     friend void UnsharpMask ( SingleSpectrum& spec, uint radius, double sigma );
     friend std::pair< uint, double > AutoOptimize ( SingleSpectrum& spec, uint max_radius, uint max_sigma );
 
-    friend SingleSpectrum Spectrum::GrandSpectrum();
-    friend SingleSpectrum Spectrum::Limits();
+    friend class GrandAccumulator;
+
+    /*!
+     * \brief Decode the power values of a lazily loaded spectrum, see LoadPolicy.
+     *
+     * Every operation that needs power values calls this function automatically, so there is
+     * rarely any need to call it directly, other than to decode many spectra up front
+     * (e.g. in parallel). Does nothing if the power values are already in memory.
+     *
+     * Power values that have been spilled to disk (see Spill()) are read back in the same way,
+     * and quantized power values (see LoadPolicy::Quantized) are expanded in the same way.
+     *
+     * Power values are only ever read back as they were, so this function is const and may be
+     * called on const spectra. Note that it is not thread-safe for a single spectrum.
+     *
+     * \throws std::logic_error
+     * Thrown if the power values have been evicted.
+     */
+    void Materialize() const;
+
+    /*!
+     * \brief Move power values and uncertainties out of memory and into a spill file.
+     *
+     * Header information, size() and all frequency functions remain available. The values
+     * are read back automatically the next time an operation needs them, see Materialize().
+     * Does nothing if the values are not currently in memory, or are quantized (which already
+     * takes far less memory).
+     *
+     * \param file
+     * Spill file to write to.
+     *
+     * \param modified
+     * Set to false if the values have not changed since they were last read back from file,
+     * in which case they are dropped from memory without being written again.
+     */
+    void Spill( std::shared_ptr<SpillFile> file, bool modified = true );
+
+    /*!
+     * \brief Get the number of bytes of memory currently used by power values and uncertainties.
+     */
+    size_t ResidentBytes() const;
+
+    /*!
+     * \brief Release the memory held by power values and uncertainties.
+     *
+     * Intended to be used once a spectrum has been folded into a Grand Spectrum
+     * (or anywhere else its values are no longer needed). Header information, size() and
+     * all frequency functions remain available, but any operation that needs power
+     * values will throw a std::logic_error.
+     */
+    void Evict();
 
     /*!
      * \brief Perform initial binning of a raw power spectrum and initializes spectrum uncertainties.
      *
+     * Each bin holds the mean of bin_points consecutive points, and each bin starts
+     * bin_points*(1 - overlap) points (rounded) after the previous one, but at least one point
+     * after it. Points left over at the end that do not fill a whole bin are dropped.
+     *
      * \param bin_points
      * The number of points that should be put into a single bin.
+     *
+     * \param overlap
+     * Fraction of its points each bin shares with the next, from 0 (no overlap) up to but
+     * not including 1.
+     *
+     * \throws std::invalid_argument
+     * Thrown if spectrum is not in units of Watts, bin_points is zero or overlap is outside [0,1).
      */
-    void InitialBin (uint bin_points = 32);
+    void InitialBin (uint bin_points = 32, double overlap = 0.5);
 
     /*!
      * \brief Covert from units of dBm to Watts.
@@ -206,28 +329,46 @@ class SingleSpectrum {
      */
     void LorentzianWeight();
 
+    /*!
+     * \brief Convert from units of dBm or Watts all the way to units of AxionPower.
+     *
+     * Gives the same result as calling dBmToWatts() (if need be), WattsToExcessPower(),
+     * LorentzianWeight() and KSVZWeight() in turn, but visits each point once rather than once
+     * per step (plus one pass to find the mean) and computes each weight once per bin.
+     *
+     * \throws std::invalid_argument
+     * Thrown if spectrum is not in units of dBm or Watts.
+     */
+    void ConvertToAxionPower();
+
+    /*!
+     * \brief Compute sum, mean, variance and norm of the current spectrum in a single pass,
+     * see SampleStatistics.
+     */
+    SampleStatistics statistics() const;
+
     /*!
      * \brief Compute the \f$ L_2 \f$ norm of the current spectrum =
      * \f$ \sqrt{\sum_{i=1}^n | P_i |^2} \f$ Then
      */
-    double norm();
+    double norm() const;
     /*!
      * \brief Compute the arithmetic mean of the current spectrum
      */
-    double mean();
+    double mean() const;
     /*!
      * \brief Compute the standard deviation of the current spectrum
      */
-    double std_dev();
+    double std_dev() const;
 
     /*!
      * \brief Get the minimum (smallest) frequency stored in the current spectrum
      */
-    double min_freq();
+    double min_freq() const;
     /*!
      * \brief Get the maximum (largest) frequency stored in the current spectrum
      */
-    double max_freq();
+    double max_freq() const;
 
     /*!
      * \brief similar to std::vector::size(), get the number of points in the current spectrum.
@@ -235,7 +376,7 @@ class SingleSpectrum {
      * Note that this corresponds to the number of power spectrum points but does not count
      * the number of uncertainty values stored.
      */
-    uint size();
+    uint size() const;
 
     /*!
      * \brief Get the current units that the Spectrum is in.
@@ -252,14 +393,26 @@ class SingleSpectrum {
      * \return
      * string expressing the current units the spectrum is in
      */
-    std::string units();
+    std::string units() const;
     /*!
-     * \brief Rebin the current spectra, averaging all power spectrum points and uncertainties
+     * \brief Rebin the current spectra, keeping the largest (most conservative) power value
+     * and uncertainty of the points in each bin.
+     *
+     * Points at the end that do not fill a whole bin are dropped, and the frequency span shrinks
+     * by them, so every bin sits at the frequencies of the points it was made from.
      *
      * \param points_per_bin
-     * The number of points that should be averaged into a signal bin
+     * The number of points that should be combined into a single bin
+     *
+     * \throws std::invalid_argument
+     * Thrown if points_per_bin is zero.
      */
     void rebin(uint points_per_bin);
+
+    /*!
+     * \brief Same as rebin(), but returns a rebinned copy and leaves the current spectrum as it is.
+     */
+    SingleSpectrum rebinned(uint points_per_bin) const;
     /*!
      * \brief Elminate bins from the head and tail of the current spectrum.
      *
@@ -277,21 +430,21 @@ class SingleSpectrum {
      * The index of the requested bin
      * \return
      */
-    double bin_start_freq(uint idx);
+    double bin_start_freq(uint idx) const;
     /*!
      * \brief  Get the frequency corresponding to the center of a bin
      * \param idx
      * The index of the requested bin
      * \return
      */
-    double bin_mid_freq(uint idx);
+    double bin_mid_freq(uint idx) const;
     /*!
      * \brief Get the frequency corresponding to the right-hand side of a bin
      * \param idx
      * The index of the requested bin
      * \return
      */
-    double bin_width();
+    double bin_width() const;
 
     /*!
      * \brief Get the index of the bin correspond to a given frequency
@@ -301,27 +454,52 @@ class SingleSpectrum {
      *
      * \throws std::out_of_range
      * Thrown if the requested frequency is not in the current spectrum, that is
-     * if frequency \f$ \notin \f$ [ min_freq(), max_freq() ]
+     * if frequency \f$ \notin \f$ [ min_freq(), max_freq() ], or if the spectrum has no bins.
      */
-    uint bin_at_frequency(double frequency);
+    uint bin_at_frequency(double frequency) const;
 
   private:
 
+    //Where the power values of this spectrum currently are.
+    //Note that current_units is already Units::Watts while Pending or Quantized, even though
+    //pending_data and quantized_power still hold dBm- Materialize() converts them to Watts as
+    //it decodes them, so nothing may read the power values without calling it first.
+    enum class Payload {Resident, Pending, Quantized, Spilled, Evicted};
+
     Units current_units = Units::dBm;
 
-    void ParseRawData(std::string raw);
-    uint num_lines(std:: string raw_data);
+    //Decoding or reading back power values does not change what a spectrum holds, so
+    //Materialize() is const and the payload itself is mutable
+    mutable Payload payload_state = Payload::Resident;
+    mutable boost::string_ref pending_data; //raw data still to be decoded, only used when Pending
+    uint pending_points = 0; //size() when the power values are not Resident
+
+    //power values in dBm, only used when Quantized, see quantize()
+    mutable QuantizedList quantized_power;
+    double quantized_offset = 0.0;
+    double quantized_step = 0.0;
+
+    std::shared_ptr<SpillRegion> spill_region; //where values were last spilled, if anywhere
+    uint spilled_uncertainties = 0;
+
+    void ParseRawData(boost::string_ref raw);
 
     void FillFromHeader(std::map<std::string, double> header);
+    void CopyHeader(const SingleSpectrum& other);
+
+    template <typename E>
+    void Assign(const E& expression);
+    void Decoded(LoadPolicy policy);
     void PopulateUncertainties(uint rebin_size);
+    void ShrinkSpan(uint points_kept, uint num_points);
+    double UniformUncertainty(uint rebin_size) const;
+
+    static void ConvertToWatts(PowerList& power_list);
 
-    double sum( std::vector<double>& data_list , double exponent = 1.0 );
-    double mean( std::vector<double>& data_list );
-    double std_dev( std::vector<double>& data_list );
     double kszv_power_per_bin( double freq_mhz );
 
-    std::vector<double> sa_power_list;
-    std::vector<double> uncertainties;
+    mutable PowerList sa_power_list;
+    mutable PowerList uncertainties;
 
     double center_frequency = 0.0; //MHz
     double frequency_span = 0.0; //MHz
@@ -334,4 +512,61 @@ class SingleSpectrum {
     uint fft_points = 0; //Number of time-series points used to make FFT
 };
 
+template <typename E>
+SingleSpectrum::SingleSpectrum(const SpectrumExpression<E>& expression) {
+    Assign( expression.derived() );
+}
+
+template <typename E>
+SingleSpectrum& SingleSpectrum::operator=(const SpectrumExpression<E>& expression) {
+    Assign( expression.derived() );
+    return *this;
+}
+
+template <typename E>
+void SingleSpectrum::Assign(const E& expression) {
+
+    const SingleSpectrum& prototype = expression.prototype();
+
+    if( &prototype != this ) {
+        CopyHeader( prototype );
+    }
+
+    //every spectrum in the expression has been materialized and has the same size, so if
+    //this spectrum is one of them its lists are already the right size and are not reallocated
+    const uint n = expression.size();
+    const bool with_uncertainties = expression.has_uncertainties();
+
+    payload_state = Payload::Resident;
+    pending_data.clear();
+    QuantizedList().swap( quantized_power );
+
+    sa_power_list.resize( n );
+    if( with_uncertainties ) {
+        uncertainties.resize( n );
+    } else {
+        uncertainties.clear();
+    }
+
+    spectrum_value* power = sa_power_list.data();
+    spectrum_value* uncertainty = uncertainties.data();
+
+    if( with_uncertainties ) {
+        #pragma omp simd aligned( power, uncertainty : power_list_alignment )
+        for( uint i = 0; i < n; i++ ) {
+            //both are computed before either is stored, in case this spectrum is an operand
+            double value = expression.power( i );
+            double variance = expression.variance( i );
+
+            power[i] = value;
+            uncertainty[i] = std::sqrt( variance );
+        }
+    } else {
+        #pragma omp simd aligned( power : power_list_alignment )
+        for( uint i = 0; i < n; i++ ) {
+            power[i] = expression.power( i );
+        }
+    }
+}
+
 #endif // SINGLESPECTRUM_H
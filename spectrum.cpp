@@ -20,6 +20,7 @@
 #include <utility>     //std::make_pair
 #include <map>         //std::map
 #include <mutex> //protect against concurrent access when using (unordered) parallel for loops
+#include <exception>   //std::exception_ptr
 
 // Boost Headers
 #include <boost/algorithm/string.hpp>  //split() and is_any_of for parsing .csv files
@@ -33,137 +34,285 @@
 //Project Specific Headers
 #include "singlespectrum.h"
 #include "physicsfunctions.h"
+#include "spillfile.h"
+#include "spectrumview.h"
+#include "spectrumpyramid.h"
+#include "grandaccumulator.h"
 
 
 Spectrum::Spectrum() {}
+
+Spectrum::Spectrum( std::string spill_dir, size_t resident_budget ) {
+    spill_file = std::make_shared<SpillFile>( spill_dir );
+    this->resident_budget = resident_budget;
+}
+
 Spectrum::~Spectrum() {}
 
-uint Spectrum::size() {
+void Spectrum::Release( uint idx, bool was_modified ) {
+
+    if( !spill_file ) {
+        return;
+    }
+
+    modified[idx] = modified[idx] || was_modified;
+
+    if( queued[idx] ) {
+        //move to the back, it is now the most recently used
+        resident_queue.splice( resident_queue.end(), resident_queue, queue_position[idx] );
+        resident_bytes -= queued_bytes[idx];
+    } else {
+        queue_position[idx] = resident_queue.insert( resident_queue.end(), idx );
+        queued[idx] = true;
+    }
+
+    //the spectrum may have changed size since it was last released
+    queued_bytes[idx] = spectra[idx].ResidentBytes();
+    resident_bytes += queued_bytes[idx];
+
+    while( resident_bytes > resident_budget && resident_queue.size() > 1 ) {
+        uint oldest = resident_queue.front();
+        resident_queue.pop_front();
+
+        resident_bytes -= queued_bytes[oldest];
+        spectra[oldest].Spill( spill_file, modified[oldest] );
+
+        queued[oldest] = false;
+        modified[oldest] = false;
+    }
+}
+
+uint Spectrum::size() const {
     return spectra.size();
 }
 
 
-SingleSpectrum Spectrum::BlankGrandSpectrum () {
+void Spectrum::SetGrandGrid( GridSpacing spacing, bool sparse, double bin_width ) {
 
-    if( size() == 0 ) {
+    if( spacing == GridSpacing::Fixed && !( bin_width > 0.0 ) ) {
         std::string err_mesg = __FUNCTION__;
-        err_mesg += "\nCannot build a Grand Spectrum- no spectra loaded.";
+        err_mesg += "\nA fixed grid needs a positive bin width.";
         throw std::invalid_argument(err_mesg);
     }
 
-    uint total_bins = 0;
-    std::vector<double> min_freqs;
-    std::vector<double> max_freqs;
+    grand_grid = GrandGrid { spacing, sparse, bin_width };
+    grand_valid = false;
+}
 
-    std::mutex guard;
+//Grand bins covered by a single spectrum, [first_bin, last_bin)
+struct GrandCoverage {
+    uint index;
+    uint first_bin;
+    uint last_bin;
+};
+
+//Stretch of grand bins [first_bin, last_bin) covered by the same spectra, see BuildGrandAccumulator()
+struct GrandSegment {
+    uint first_bin;
+    uint last_bin;
+    uint first_source;
+    uint num_sources;
+};
+
+//Segments are gathered until they hold at least this many bins, then summed by every thread at once
+const uint grand_batch_bins = 1 << 14;
+
+void SumSegments( const std::vector<GrandSegment>& segments, const std::vector<GrandSource>& sources,
+                  GrandAccumulator& grand, double* weighted_power, double* total_weight, uint* num_covering ) {
+
+    if( segments.empty() ) {
+        return;
+    }
+
+    const uint batch_start = segments.front().first_bin;
+    const uint batch_end = segments.back().last_bin;
 
     #pragma omp parallel for
-    for (uint i = 0; i < spectra.size() ; i ++ ) {
-        guard.lock();
-        total_bins += spectra.at(i).size();
-        min_freqs.push_back( spectra.at(i).min_freq() );
-        max_freqs.push_back( spectra.at(i).max_freq() );
-        guard.unlock();
-    }
+    for( uint i = batch_start; i < batch_end; i++ ) {
 
-    auto min = std::min_element(min_freqs.begin(),min_freqs.end());
-    double min_frequency = static_cast<double>(*min);
+        auto segment = std::upper_bound( segments.begin(), segments.end(), i,
+                                         []( uint bin, const GrandSegment& seg ) { return bin < seg.last_bin; } );
 
-    auto max = std::max_element(max_freqs.begin(),max_freqs.end());
-    double max_frequency = static_cast<double>(*max);
+        const GrandSource* source = sources.data() + segment->first_source;
 
-    return SingleSpectrum (total_bins, min_frequency, max_frequency);
-}
+        double g_frequency_at_i = grand.mid_freq( i );
 
-inline double overlap_power_weight( double power_a, double power_b, double delta_a, double delta_b ) {
-    double tau_a = 1.0/pow( delta_a, 2.0 );
-    double tau_b = 1.0/pow( delta_b, 2.0 );
-    return (tau_a*power_a+tau_b*power_b)/(tau_a + tau_b);
-}
+        double power_sum = 0.0;
+        double weight_sum = 0.0;
 
-inline double overlap_uncertainity_weight( double delta_a, double delta_b ) {
-    double tau_a = 1.0/pow( delta_a, 2.0 );
-    double tau_b = 1.0/pow( delta_b, 2.0 );
-    return sqrt((1.0)/(tau_a + tau_b));
-}
+        for( uint j = 0; j < segment->num_sources; j++ ) {
 
-inline bool check_frequency( double to_check , SingleSpectrum& check_against) {
-    return !( to_check > check_against.max_freq() || to_check < check_against.min_freq());
+            uint bin = source[j].bin( g_frequency_at_i );
+            double weight = inverse_variance( source[j].uncertainty[bin] );
+
+            power_sum += weight*source[j].power[bin];
+            weight_sum += weight;
+        }
+
+        weighted_power[i] = power_sum;
+        total_weight[i] = weight_sum;
+        num_covering[i] = segment->num_sources;
+    }
 }
 
+void Spectrum::BuildGrandAccumulator() {
 
-SingleSpectrum Spectrum::GrandSpectrum() {
+    GrandAccumulator grand = GrandAccumulator::Plan( spectra, grand_grid );
+    uint g_size = grand.size();
 
-    auto grand_spectrum = BlankGrandSpectrum();
-    uint g_size = grand_spectrum.size();
+    //Only headers are needed to find which grand bins each spectrum covers
+    std::vector<GrandCoverage> coverage( size() );
 
     #pragma omp parallel for
-    for(uint i=0; i< g_size; i++) {
+    for( uint k = 0; k < size() ; k++ ) {
+        const auto& spec = spectra[k];
+
+        auto bins = grand.covered_bins( spec.min_freq(), spec.max_freq() );
 
-        double g_frequency_at_i = grand_spectrum.bin_mid_freq(i);
+        if( spec.size() == 0 ) {
+            bins.second = bins.first;
+        }
 
-        for(uint k = 0; k < size() ; k++ ) {
+        coverage[k] = GrandCoverage { k, bins.first, bins.second };
+    }
 
-            if ( check_frequency(g_frequency_at_i, spectra.at(k)) ) {
+    //Sweep across the grand spectrum from low to high frequency. Spectra join the sweep in
+    //order of frequency and leave it once it has passed them, so each grand bin only ever looks
+    //at the spectra that actually cover it, and only those need to be in memory.
+    std::vector<GrandCoverage> by_start( coverage );
+    std::stable_sort( by_start.begin(), by_start.end(),
+                      []( const GrandCoverage& a, const GrandCoverage& b ) { return a.first_bin < b.first_bin; } );
 
-                uint bin_number = spectra.at(k).bin_at_frequency( g_frequency_at_i );
+    std::vector<GrandCoverage> by_end( coverage );
+    std::stable_sort( by_end.begin(), by_end.end(),
+                      []( const GrandCoverage& a, const GrandCoverage& b ) { return a.last_bin < b.last_bin; } );
 
-                if ( grand_spectrum.sa_power_list.at(i) != 0.0 ) {
+    //spectra covering the current grand bins, kept in index order so that every grand bin
+    //sums its spectra in the same order as the spectra were loaded
+    std::vector<uint> active;
 
-                    double current_power = grand_spectrum.sa_power_list.at(i);
-                    double overlap_power = spectra.at(k).sa_power_list.at(bin_number);
+    //the current batch, spectra that have left the sweep are only released once it is summed
+    std::vector<GrandSegment> segments;
+    std::vector<GrandSource> sources;
+    std::vector<uint> finished;
+    uint batch_bins = 0;
 
-                    double current_uncertainty = grand_spectrum.uncertainties.at(i);
-                    double overlap_uncertainity = spectra.at(k).uncertainties.at(bin_number);
+    auto next_start = by_start.begin();
+    auto next_end = by_end.begin();
 
-                    grand_spectrum.sa_power_list.at(i) = overlap_power_weight( current_power,\
-                                                         overlap_power,\
-                                                         current_uncertainty,\
-                                                         overlap_uncertainity );
+    uint segment_start = 0;
 
-                    grand_spectrum.uncertainties.at(i) = overlap_uncertainity_weight(\
-                                                         current_uncertainty,\
-                                                         overlap_uncertainity );
+    while( segment_start < g_size ) {
 
-                } else {
+        while( next_end != by_end.end() && next_end->last_bin <= segment_start ) {
+            auto leaving = std::lower_bound( active.begin(), active.end(), next_end->index );
 
-                    grand_spectrum.sa_power_list.at(i) = spectra.at(k).sa_power_list.at(bin_number);
-                    grand_spectrum.uncertainties.at(i) = spectra.at(k).uncertainties.at(bin_number);
+            if( leaving != active.end() && *leaving == next_end->index ) {
+                active.erase( leaving );
+                finished.push_back( next_end->index );
+            }
 
-                }
+            ++next_end;
+        }
 
-            } else {
-                continue;
+        while( next_start != by_start.end() && next_start->first_bin <= segment_start ) {
+            if( next_start->last_bin > segment_start ) {
+                active.insert( std::lower_bound( active.begin(), active.end(), next_start->index ), next_start->index );
             }
 
+            ++next_start;
+        }
+
+        //the set of spectra stays the same until the next spectrum joins or leaves
+        uint segment_end = g_size;
+        if( next_start != by_start.end() ) {
+            segment_end = std::min( segment_end, next_start->first_bin );
         }
+        if( next_end != by_end.end() ) {
+            segment_end = std::min( segment_end, next_end->last_bin );
+        }
+
+        segments.push_back( GrandSegment { segment_start, segment_end,
+                                           static_cast<uint>( sources.size() ),
+                                           static_cast<uint>( active.size() ) } );
+
+        for( const auto& k : active ) {
+            sources.push_back( GrandAccumulator::Source( spectra[k] ) );
+        }
+
+        batch_bins += segment_end - segment_start;
+        segment_start = segment_end;
+
+        if( batch_bins >= grand_batch_bins || segment_start == g_size ) {
+            SumSegments( segments, sources, grand,
+                         grand.weighted_power.data(), grand.total_weight.data(), grand.num_covering.data() );
+
+            for( const auto& k : finished ) {
+                Release( k, false );
+            }
+
+            segments.clear();
+            sources.clear();
+            finished.clear();
+            batch_bins = 0;
+        }
+    }
+
+    for( const auto& k : active ) {
+        Release( k, false );
+    }
+
+    grand_accumulator = std::move( grand );
+    grand_valid = true;
+}
+
+SingleSpectrum Spectrum::GrandSpectrum() {
+
+    if( !grand_valid ) {
+        BuildGrandAccumulator();
     }
 
-    grand_spectrum.current_units = Units::AxionPower;
-    return grand_spectrum;
+    return grand_accumulator.GrandSpectrum();
 }
 
-template<typename T> inline T positive_part ( T& x ) {
-    return ( x < 0 )? 0 : x;
+std::vector<SingleSpectrum> Spectrum::GrandSpectrumRuns() {
+
+    if( !grand_valid ) {
+        BuildGrandAccumulator();
+    }
+
+    return grand_accumulator.GrandSpectrumRuns();
 }
 
-SingleSpectrum Spectrum::Limits() {
+SingleSpectrum Spectrum::Limits( uint points_per_bin ) {
 
-    auto g_spectrum = GrandSpectrum();
+    if( !grand_valid ) {
+        BuildGrandAccumulator();
+    }
 
-    for (uint i = 0; i < g_spectrum.size() ; i++ ) {
+    return grand_accumulator.Limits( points_per_bin );
+}
+
+SpectrumPyramid Spectrum::LimitsPyramid() {
+    return SpectrumPyramid( UnbinnedLimits() );
+}
 
-        double gc_power = positive_part( g_spectrum.sa_power_list[i]);
-        double excl_90_watts = gc_power + 1.282*g_spectrum.uncertainties[i];
+SingleSpectrum Spectrum::UnbinnedLimits() {
 
-        g_spectrum.sa_power_list[i] = KSVZ_axion_coupling( g_spectrum.bin_mid_freq(i) )*sqrt( excl_90_watts );
-        g_spectrum.uncertainties[i] = KSVZ_axion_coupling( g_spectrum.bin_mid_freq(i) );
+    if( !grand_valid ) {
+        BuildGrandAccumulator();
     }
 
-    g_spectrum.rebin( 600 );
-    g_spectrum.current_units = Units::ExclLimit90;
+    return grand_accumulator.UnbinnedLimits();
+}
 
-    return g_spectrum;
+std::vector<SingleSpectrum> Spectrum::UnbinnedLimitRuns() {
+
+    if( !grand_valid ) {
+        BuildGrandAccumulator();
+    }
+
+    return grand_accumulator.UnbinnedLimitRuns();
 }
 
 inline double axion_coupling_power( double g_spec_power, double g_spec_mid_freq ) {
@@ -174,60 +323,208 @@ inline double axion_coupling_uncertainity ( double g_spec_uncertainity, double g
     return g_spec_uncertainity*pow(KSVZ_axion_coupling(g_spec_mid_freq),2.0);
 }
 
+void Spectrum::Materialize() {
+
+    std::exception_ptr decode_error;
+    std::mutex guard;
+
+    #pragma omp parallel for schedule( dynamic )
+    for( uint i = 0; i < spectra.size() ; i++ ) {
+        try {
+            spectra[i].Materialize();
+        } catch ( ... ) {
+            std::lock_guard<std::mutex> lock ( guard );
+            if ( !decode_error ) {
+                decode_error = std::current_exception();
+            }
+        }
+    }
+
+    if ( decode_error ) {
+        std::rethrow_exception( decode_error );
+    }
+}
+
+void Spectrum::Evict() {
+
+    for( auto& spec : spectra ) {
+        spec.Evict();
+    }
+
+    resident_queue.clear();
+    queued.assign( queued.size(), false );
+    resident_bytes = 0;
+    modified.assign( modified.size(), false );
+}
+
 //Operation does not seem to benefit from parallelism
 void Spectrum::dBmToWatts() {
 
-    for( auto& spec : spectra ) {
-        spec.dBmToWatts();
+    grand_valid = false;
+
+    for( uint i = 0; i < spectra.size() ; i++ ) {
+        spectra[i].dBmToWatts();
+        Release( i, true );
     }
 }
 
 //Operation does not seem to benefit from parallelism
 void Spectrum::WattsToExcessPower() {
 
-    for( auto& spec : spectra ) {
-        spec.WattsToExcessPower();
+    grand_valid = false;
+
+    for( uint i = 0; i < spectra.size() ; i++ ) {
+        spectra[i].WattsToExcessPower();
+        Release( i, true );
     }
 }
 
 //Operation does not seem to benefit from parallelism
 void Spectrum::KSVZWeight() {
 
-    for( auto& spec : spectra ) {
-        spec.KSVZWeight();
+    grand_valid = false;
+
+    for( uint i = 0; i < spectra.size() ; i++ ) {
+        spectra[i].KSVZWeight();
+        Release( i, true );
     }
 
 }
 
 void Spectrum::LorentzianWeight() {
 
-    for( auto& spec : spectra ) {
-        spec.LorentzianWeight();
+    grand_valid = false;
+
+    for( uint i = 0; i < spectra.size() ; i++ ) {
+        spectra[i].LorentzianWeight();
+        Release( i, true );
     }
 
 }
 
-//Operation does not seem to benefit from parallelism
-SingleSpectrum Spectrum::at( uint idx ) {
+void Spectrum::ConvertToAxionPower() {
+
+    grand_valid = false;
+
+    for( uint i = 0; i < spectra.size() ; i++ ) {
+        spectra[i].ConvertToAxionPower();
+        Release( i, true );
+    }
+}
+
+const SingleSpectrum& Spectrum::at( uint idx ) const {
     return spectra.at( idx );
+}
+
+SpectrumView Spectrum::view( uint idx ) {
+
+    SpectrumView spec_view( spectra.at( idx ) );
+    Release( idx, false );
 
+    return spec_view;
 }
 
-Spectrum &Spectrum::operator+=(SingleSpectrum& spec) {
+void Spectrum::Added() {
+
+    if( spill_file ) {
+        queue_position.push_back( resident_queue.end() );
+        queued.push_back( false );
+        modified.push_back( false );
+        queued_bytes.push_back( 0 );
+        Release( spectra.size() - 1, true );
+    }
+}
+
+void Spectrum::AddToGrand( uint idx ) {
+
+    if( grand_valid && grand_accumulator.Accepts( spectra[idx] ) &&
+            !grand_accumulator.ChangesLayout( spectra[idx], true ) ) {
+        grand_accumulator.Add( spectra[idx] );
+    } else {
+        grand_valid = false;
+    }
+}
+
+void Spectrum::RemoveFromGrand( uint idx ) {
+
+    if( grand_valid && spectra.size() > 1 &&
+            grand_accumulator.Accepts( spectra[idx] ) && grand_accumulator.Covers( spectra[idx] ) &&
+            !grand_accumulator.ChangesLayout( spectra[idx], false ) ) {
+        grand_accumulator.Remove( spectra[idx] );
+    } else {
+        grand_valid = false;
+    }
+}
+
+Spectrum &Spectrum::operator+=(const SingleSpectrum& spec) {
 
     spectra.push_back(spec);
+    Added();
+    AddToGrand( spectra.size() - 1 );
 
     return *this;
 }
 
-Spectrum &Spectrum::operator-=(SingleSpectrum& spec) {
+Spectrum &Spectrum::operator+=(SingleSpectrum&& spec) {
 
-    for( uint i = 0; i < spectra.size() ; i++ ) {
+    spectra.push_back( std::move( spec ) );
+    Added();
+    AddToGrand( spectra.size() - 1 );
+
+    return *this;
+}
+
+Spectrum &Spectrum::operator-=(const SingleSpectrum& spec) {
 
-        if( spectra[i] == spec ) {
-            spectra.erase( spectra.begin() + i );
+    for( uint i = 0; i < spectra.size() ; ) {
+
+        //spectra with different frequencies cannot be the same spectrum, so their
+        //power values are never decoded (or read back from disk) just to compare them
+        bool same_grid = spectra[i].size() == spec.size() &&
+                         spectra[i].min_freq() == spec.min_freq() &&
+                         spectra[i].max_freq() == spec.max_freq();
+
+        if( same_grid && spectra[i] == spec ) {
+            //the next spectrum moves down into position i
+            erase( i );
+            continue;
         }
+
+        if( same_grid ) {
+            Release( i, false );
+        }
+
+        i++;
     }
 
     return *this;
 }
+
+void Spectrum::erase( uint idx ) {
+
+    if( idx >= spectra.size() ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nRequested index is greater than the number of loaded spectra.";
+        throw std::out_of_range(err_mesg);
+    }
+
+    RemoveFromGrand( idx );
+    spectra.erase( spectra.begin() + idx );
+
+    if( spill_file ) {
+        if( queued[idx] ) {
+            resident_queue.erase( queue_position[idx] );
+            resident_bytes -= queued_bytes[idx];
+        }
+
+        queue_position.erase( queue_position.begin() + idx );
+        queued.erase( queued.begin() + idx );
+        modified.erase( modified.begin() + idx );
+        queued_bytes.erase( queued_bytes.begin() + idx );
+
+        //every spectrum after idx has moved down by one
+        for( auto& i : resident_queue ) {
+            i -= ( i > idx );
+        }
+    }
+}
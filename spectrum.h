@@ -8,6 +8,9 @@
 #include <string>
 #include <map>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <utility>
 
 //Boost Headers
 //
@@ -16,11 +19,14 @@
 //
 
 //Project Specific Headers
-//
+#include "grandaccumulator.h"
 
 enum class Units {dBm, Watts, ExcessPower, AxionPower, ExclLimit90};
 
 class SingleSpectrum;
+class SpectrumView;
+class SpectrumPyramid;
+class SpillFile;
 
 /*!
  * \brief Container class designed to hold all the individual spectra collected
@@ -31,29 +37,86 @@ class SingleSpectrum;
  *
  * Additionally class is designed to generated Grand Spectra and Exclusion Limits,
  * operations that require many individual spectra.
+ *
+ * By default every spectrum is kept in memory. For data sets larger than memory a Spectrum
+ * may instead be given a spill directory and a resident budget, in which case the power values
+ * and uncertainties of the least recently used spectra are moved to a spill file (see SpillFile)
+ * whenever the spectra held in memory exceed the budget. Batch operations, GrandSpectrum() and
+ * Limits() visit spectra one at a time, so they only ever need a budget's worth of memory.
  */
 class Spectrum {
   public:
     Spectrum();
+
+    /*!
+     * \brief Create a Spectrum that keeps at most resident_budget bytes of
+     * power values and uncertainties in memory.
+     *
+     * \param spill_dir
+     * Directory spilled spectra are written to, see SpillFile::SpillFile.
+     *
+     * \param resident_budget
+     * Memory (in bytes) that resident spectra may use. The most recently used spectrum is
+     * always kept in memory, even if it alone is larger than the budget.
+     */
+    Spectrum( std::string spill_dir, size_t resident_budget );
     ~Spectrum();
 
     /*!
-     * \brief Similar to std::vector::push_back()- insert a SingleSpectrum
+     * \brief Similar to std::vector::push_back()- insert a copy of a SingleSpectrum
      * at the back of the Spectrum class.
      *
+     * Once a Grand Spectrum has been built, a spectrum that fits it (see GrandAccumulator::Accepts())
+     * and can be added by growing its grid (see GrandAccumulator::ChangesLayout()) is folded
+     * straight into it, so the next GrandSpectrum() or Limits() only has to redo the frequencies
+     * it covers. Otherwise the Grand Spectrum is rebuilt from scratch the next
+     * time it is needed- with the default GridSpacing::Combined that is after every spectrum added.
+     *
      * \param spec
      * The SingleSpectrum class to be added.
      */
-    Spectrum &operator+=(SingleSpectrum& spec);
+    Spectrum &operator+=(const SingleSpectrum& spec);
+
+    /*!
+     * \brief Insert a SingleSpectrum at the back of the Spectrum class, taking
+     * ownership of its power values and uncertainties rather than copying them.
+     *
+     * \param spec
+     * The SingleSpectrum class to be added, it is left empty.
+     */
+    Spectrum &operator+=(SingleSpectrum&& spec);
+
+    /*!
+     * \brief Similar to std::vector::emplace_back()- construct a SingleSpectrum in place
+     * at the back of the Spectrum class, e.g. spectra.emplace_back( raw_data, LoadPolicy::Lazy ).
+     *
+     * \return
+     * The newly added spectrum.
+     */
+    template <typename... Args>
+    SingleSpectrum& emplace_back(Args&&... args);
 
     /*!
      * \brief Remove a SingleSpectrum class that has already been emplaced.
      *
+     * As with operator+=, the spectrum is taken back out of an existing Grand Spectrum
+     * by only updating the frequencies it covers. Only spectra with the same size and
+     * frequencies as spec have their power values compared, so no other spectrum is decoded.
+     *
      * \param spec
      * SingleSpectrum object to be remove- if no such object is present this
-     *  function does nothing.
+     *  function does nothing. Every matching spectrum is removed.
      */
-    Spectrum &operator-=(SingleSpectrum& spec);
+    Spectrum &operator-=(const SingleSpectrum& spec);
+
+    /*!
+     * \brief Similar to std::vector::erase()- remove the SingleSpectrum at a particular
+     * index position, without comparing any power values. Spectra after it move down by one.
+     *
+     * \throws std::out_of_range
+     * Thrown if idx >= size()
+     */
+    void erase(uint idx);
 
     /*!
      * \brief Combine all currently loaded spectra to form a Grand Spectrum.
@@ -64,19 +127,104 @@ class Spectrum {
      * Note that the currently loaded spectra are not altered in any way
      *  when this function is called.
      *
+     * Spectra are swept from low to high frequency, so each grand bin only visits the spectra
+     * that cover it and only those spectra need to be in memory at once. The result is kept (see
+     * GrandAccumulator) and updated as spectra are added or removed, so calling GrandSpectrum() or
+     * Limits() again only costs as much as the changes since the last call. Batch operations such as
+     * ConvertToAxionPower() change every spectrum, so the Grand Spectrum is rebuilt after them.
+     *
+     * The frequency grid is chosen when the Grand Spectrum is built (see SetGrandGrid()). With
+     * GridSpacing::Fixed or Finest it grows by whole grand bins as spectra above it are added, and
+     * is otherwise laid out again, so it is the same grid however the spectra were added (see
+     * GrandAccumulator). Frequencies between the runs of a sparse grid are returned as zero.
+     *
+     * \throws std::out_of_range
+     * Thrown if the uncertainties of a spectrum have not been populated.
+     *
      * \return
      * A Grand Spectrum with an appropiate min. and max. frequency.
      */
     SingleSpectrum GrandSpectrum();
 
+    /*!
+     * \brief As GrandSpectrum(), but with one SingleSpectrum per run of grand bins (see GrandRun)
+     * rather than filling the gaps between them.
+     *
+     * With the default dense grid this is a single spectrum, identical to GrandSpectrum().
+     */
+    std::vector<SingleSpectrum> GrandSpectrumRuns();
+
+    /*!
+     * \brief Choose the frequency grid of the Grand Spectrum and Limits, see GrandGrid.
+     *
+     * By default grand bins are spaced with GridSpacing::Combined on a dense grid, so a data run
+     * with heavily overlapping spectra, or large gaps between them, has far more grand bins than
+     * it resolves. GridSpacing::Finest (or a Fixed width) with a sparse grid instead keeps one
+     * grand bin per resolved frequency, and only where some spectrum was taken, which saves
+     * memory and time building the Grand Spectrum and Limits. It also lets spectra added one at a
+     * time be folded into the Grand Spectrum rather than rebuilding it, see operator+=().
+     *
+     * The Grand Spectrum is rebuilt with the new grid the next time it is needed.
+     *
+     * \param bin_width
+     * Width (in MHz) of grand bins, only used with GridSpacing::Fixed.
+     *
+     * \throws std::invalid_argument
+     * Thrown if spacing is GridSpacing::Fixed and bin_width is not positive.
+     */
+    void SetGrandGrid( GridSpacing spacing, bool sparse = false, double bin_width = 0.0 );
+
     /*!
      * \brief Combine all currently loaded spectra to form a 90% exclusion Limit.
      *
+     * The result is UnbinnedLimits().rebin( points_per_bin ), but each run of grand bins is
+     * rebinned on its own so the gaps of a sparse grid are never filled in.
+     *
+     * \param points_per_bin
+     * Number of Grand Spectrum bins combined into each limit, see SingleSpectrum::rebin().
      *
      * \return
      * A SingleSpectrum class with 'power' value representing the exclusion Limit values.
      */
-    SingleSpectrum Limits();
+    SingleSpectrum Limits( uint points_per_bin = 600 );
+
+    /*!
+     * \brief Combine all currently loaded spectra to form 90% exclusion Limits at every
+     * bin size at once, see SpectrumPyramid.
+     *
+     * LimitsPyramid().Rebinned( n ) is identical to Limits( n ), but once the pyramid is built
+     * limits at any other bin size (or zoomed in plots) are available without rebuilding the
+     * Grand Spectrum.
+     */
+    SpectrumPyramid LimitsPyramid();
+
+    /*!
+     * \brief Combine all currently loaded spectra to form a 90% exclusion Limit for every
+     * Grand Spectrum bin, i.e. Limits( 1 ).
+     */
+    SingleSpectrum UnbinnedLimits();
+
+    /*!
+     * \brief As UnbinnedLimits(), but with one SingleSpectrum per run of grand bins, see GrandSpectrumRuns().
+     */
+    std::vector<SingleSpectrum> UnbinnedLimitRuns();
+
+    /*!
+     * \brief Call SingleSpectrum::Materialize() on all loaded spectra, decoding
+     * the power values of any lazily loaded spectra in parallel.
+     *
+     * Note that this brings every spectrum into memory at once, regardless of any resident budget.
+     */
+    void Materialize();
+
+    /*!
+     * \brief Call SingleSpectrum::Evict() on all loaded spectra, e.g. once a
+     * Grand Spectrum has been built and the individual spectra are no longer needed.
+     *
+     * GrandSpectrum(), Limits() etc. keep returning the Grand Spectrum built before eviction,
+     * until something (such as adding a spectrum outside of it) makes it rebuild.
+     */
+    void Evict();
 
     /*!
      * \brief Call SingleSpectrum::dBmToWatts() on all loaded spectra.
@@ -98,6 +246,11 @@ class Spectrum {
      */
     void LorentzianWeight();
 
+    /*!
+     * \brief Call SingleSpectrum::ConvertToAxionPower() on all loaded spectra.
+     */
+    void ConvertToAxionPower();
+
     /*!
      * \brief Similar to std::vector::size()- get the number of
      * elements in the Spectrum.
@@ -105,7 +258,7 @@ class Spectrum {
      * \return
      * The total number of elements in the Spectrum
      */
-    uint size();
+    uint size() const;
 
     /*!
      * \brief Reset each power value and uncertainty of the Spectrum
@@ -116,16 +269,68 @@ class Spectrum {
     /*!
      * \brief Similiar to std::vector::at()- return the SingleSpectrum
      * at a particular index position.
+     *
+     * \throws std::out_of_range
+     * Thrown if idx >= size()
+     */
+    const SingleSpectrum& at(uint idx) const;
+
+    /*!
+     * \brief Get read-only access to the power values, uncertainties and frequency grid of the
+     * SingleSpectrum at a particular index position, without copying them.
+     *
+     * When a resident budget was given, the view is only valid until the next call
+     * that may spill spectra (e.g. another call to view() or a batch operation).
+     *
+     * \throws std::out_of_range
+     * Thrown if idx >= size()
      */
-    SingleSpectrum at(uint idx);
+    SpectrumView view(uint idx);
 
   private:
 
-    SingleSpectrum BlankGrandSpectrum();
+    void BuildGrandAccumulator();
+
+    GrandGrid grand_grid { GridSpacing::Combined, false, 0.0 };
+
+    //Grand Spectrum of every spectrum loaded so far, only valid while grand_valid is true
+    GrandAccumulator grand_accumulator;
+    bool grand_valid = false;
 
     double spectrum_weight(const SingleSpectrum& spec);
     std::vector<SingleSpectrum> spectra;
 
+    //Spilling, only used when a spill directory was given
+    std::shared_ptr<SpillFile> spill_file;
+    size_t resident_budget = 0;
+
+    std::list<uint> resident_queue; //resident spectra, least recently used first
+    std::vector< std::list<uint>::iterator > queue_position; //only valid while queued
+    std::vector<bool> queued;
+    std::vector<bool> modified; //changed since last spilled
+
+    //ResidentBytes() of each queued spectrum when it was last released, and their sum
+    std::vector<size_t> queued_bytes;
+    size_t resident_bytes = 0;
+
+    void Release( uint idx, bool was_modified );
+    void Added();
+
+    void AddToGrand( uint idx );
+    void RemoveFromGrand( uint idx );
+
 };
 
+template <typename... Args>
+SingleSpectrum& Spectrum::emplace_back(Args&&... args) {
+
+    spectra.emplace_back( std::forward<Args>( args )... );
+    Added();
+
+    //the new spectrum may still be changed through the reference returned
+    grand_valid = false;
+
+    return spectra.back();
+}
+
 #endif // SPECTRUM_H
@@ -0,0 +1,109 @@
+// Header for this file
+#include "spectrumarena.h"
+// C System-Headers
+#include <stdlib.h>    //posix_memalign(), free()
+// C++ System headers
+#include <new>         //std::bad_alloc
+#include <algorithm>   //std::max
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+//
+
+//Smallest block the arena allocates, so small buffers do not each get a block of their own
+const size_t min_arena_block_bytes = 1 << 20;
+
+SpectrumArena& SpectrumArena::Local() {
+    static thread_local SpectrumArena arena;
+    return arena;
+}
+
+SpectrumArena::~SpectrumArena() {
+    Release();
+}
+
+void SpectrumArena::AddBlock( size_t min_bytes ) {
+
+    size_t num_bytes = std::max( min_bytes, min_arena_block_bytes );
+    if( !blocks.empty() ) {
+        num_bytes = std::max( num_bytes, 2*blocks.back().size );
+    }
+
+    void* memory = nullptr;
+
+    if( posix_memalign( &memory, power_list_alignment, num_bytes ) != 0 ) {
+        throw std::bad_alloc();
+    }
+
+    blocks.push_back( Block { static_cast<char*>( memory ), num_bytes } );
+}
+
+void* SpectrumArena::Allocate( size_t num_bytes ) {
+
+    //keep every allocation aligned and padded, as AlignedAllocator does
+    num_bytes = ( ( num_bytes + power_list_alignment - 1 )/power_list_alignment )*power_list_alignment;
+
+    while( current_block < blocks.size() && current_used + num_bytes > blocks[current_block].size ) {
+        current_block++;
+        current_used = 0;
+    }
+
+    if( current_block == blocks.size() ) {
+        AddBlock( num_bytes );
+        current_used = 0;
+    }
+
+    void* memory = blocks[current_block].memory + current_used;
+    current_used += num_bytes;
+
+    size_t bytes_in_use = current_used;
+    for( size_t i = 0 ; i < current_block ; i++ ) {
+        bytes_in_use += blocks[i].size;
+    }
+    peak_bytes = std::max( peak_bytes, bytes_in_use );
+
+    return memory;
+}
+
+SpectrumArena::Mark SpectrumArena::GetMark() const {
+    return Mark { current_block, current_used };
+}
+
+void SpectrumArena::Rewind( Mark mark ) {
+
+    current_block = mark.block;
+    current_used = mark.used;
+
+    if( current_block != 0 || current_used != 0 || blocks.size() < 2 ) {
+        return;
+    }
+
+    size_t merged_bytes = peak_bytes;
+
+    Release();
+    AddBlock( merged_bytes );
+}
+
+void SpectrumArena::Release() {
+
+    for( auto& block : blocks ) {
+        free( block.memory );
+    }
+
+    blocks.clear();
+    current_block = 0;
+    current_used = 0;
+    peak_bytes = 0;
+}
+
+size_t SpectrumArena::Capacity() const {
+
+    size_t num_bytes = 0;
+    for( const auto& block : blocks ) {
+        num_bytes += block.size;
+    }
+
+    return num_bytes;
+}
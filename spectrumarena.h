@@ -0,0 +1,172 @@
+#ifndef SPECTRUMARENA_H
+#define SPECTRUMARENA_H
+
+// C System-Headers
+//
+// C++ System headers
+#include <vector>      //vector
+#include <cstddef>     //size_t
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "alignedallocator.h"
+
+/*!
+ * \brief Per-thread arena that scratch buffers (filter kernels, convolution outputs, copies of
+ * power values etc.) are carved from, see ArenaAllocator and ArenaScope.
+ *
+ * Allocating from an arena just moves a pointer along a block of memory that is kept from one
+ * spectrum to the next, so once the first spectrum of a run has been processed the filters no
+ * longer call malloc or touch fresh pages at all. Each thread has its own arena, so threads
+ * never contend for it.
+ *
+ * Memory is only ever handed back in bulk, by rewinding to a mark (see ArenaScope) or by
+ * calling Release().
+ */
+class SpectrumArena {
+
+  public:
+    /*!
+     * \brief Get the arena of the calling thread.
+     */
+    static SpectrumArena& Local();
+
+    ~SpectrumArena();
+
+    SpectrumArena( const SpectrumArena& ) = delete;
+    SpectrumArena& operator=( const SpectrumArena& ) = delete;
+
+    /*!
+     * \brief Get num_bytes of memory aligned to power_list_alignment bytes.
+     *
+     * \throws std::bad_alloc
+     * Thrown if a new block is needed and cannot be allocated.
+     */
+    void* Allocate( size_t num_bytes );
+
+    /*!
+     * \brief Position of the arena, memory allocated after a mark is freed by rewinding to it.
+     */
+    struct Mark {
+        size_t block;
+        size_t used;
+    };
+
+    Mark GetMark() const;
+
+    /*!
+     * \brief Free everything allocated since mark was taken.
+     *
+     * Rewinding to the very start of the arena merges all of its blocks into one, so
+     * that the next spectrum fits in a single block.
+     */
+    void Rewind( Mark mark );
+
+    /*!
+     * \brief Return all memory held by the arena to the system, e.g. at the end of a run.
+     * Nothing allocated from the arena may be used afterwards.
+     */
+    void Release();
+
+    /*!
+     * \brief Get the number of bytes currently held by the arena, used or not.
+     */
+    size_t Capacity() const;
+
+  private:
+    SpectrumArena() {}
+
+    struct Block {
+        char* memory;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current_block = 0;
+    size_t current_used = 0;
+
+    //most bytes in use at once, so that merged blocks are big enough
+    size_t peak_bytes = 0;
+
+    void AddBlock( size_t min_bytes );
+};
+
+/*!
+ * \brief Rewinds the calling thread's arena to where it was when the scope was created.
+ *
+ * Every scratch buffer drawn from the arena within the scope must be destroyed (or at least
+ * never used again) by the time the scope ends, so declare the scope before the buffers.
+ * Scopes may be nested.
+ */
+class ArenaScope {
+
+  public:
+    ArenaScope() : arena( SpectrumArena::Local() ), mark( arena.GetMark() ) {}
+
+    ~ArenaScope() {
+        arena.Rewind( mark );
+    }
+
+    ArenaScope( const ArenaScope& ) = delete;
+    ArenaScope& operator=( const ArenaScope& ) = delete;
+
+  private:
+    SpectrumArena& arena;
+    SpectrumArena::Mark mark;
+};
+
+/*!
+ * \brief Standard allocator drawing from the arena of the thread that created it.
+ *
+ * deallocate() does nothing, memory is freed when the enclosing ArenaScope ends.
+ */
+template <typename T>
+class ArenaAllocator {
+
+  public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    ArenaAllocator() noexcept : arena( &SpectrumArena::Local() ) {}
+
+    template <typename U>
+    ArenaAllocator( const ArenaAllocator<U>& other ) noexcept : arena( other.arena ) {}
+
+    T* allocate( size_t n ) {
+        return static_cast<T*>( arena->Allocate( n*sizeof( T ) ) );
+    }
+
+    void deallocate( T*, size_t ) noexcept {}
+
+    template <typename U>
+    friend class ArenaAllocator;
+
+    template <typename U, typename V>
+    friend bool operator== ( const ArenaAllocator<U>& a, const ArenaAllocator<V>& b );
+
+  private:
+    SpectrumArena* arena;
+};
+
+template <typename T, typename U>
+bool operator== ( const ArenaAllocator<T>& a, const ArenaAllocator<U>& b ) {
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!= ( const ArenaAllocator<T>& a, const ArenaAllocator<U>& b ) {
+    return !( a == b );
+}
+
+/*!
+ * \brief Scratch list of values drawn from the calling thread's arena, only valid within an ArenaScope.
+ */
+typedef std::vector< double, ArenaAllocator<double> > ScratchList;
+
+#endif // SPECTRUMARENA_H
@@ -0,0 +1,351 @@
+// Header for this file
+#include "spectrumexporter.h"
+// C System-Headers
+#include <stdio.h>   //snprintf()
+#include <stdlib.h>  //abs()
+#include <string.h>  //memcpy()
+// C++ System headers
+#include <cstdint>     //uint64_t
+#include <cmath>       //std::isfinite, std::signbit
+#include <algorithm>   //std::max
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+//
+
+//Shortest digits are found with the Grisu2 algorithm (F. Loitsch, "Printing Floating-Point
+//Numbers Quickly and Accurately with Integers", PLDI 2010). Grisu2 always produces digits
+//that read back exactly, and the shortest such digits for all but a tiny fraction of values.
+
+//Largest number of significant digits Grisu2 can produce for a double
+static const int max_significant_digits = 17;
+
+//A floating point number f x 2^e, with a 64 bit significand
+struct DiyFp {
+    uint64_t f;
+    int e;
+
+    DiyFp( uint64_t f, int e ) : f( f ), e( e ) {}
+
+    explicit DiyFp( double value ) {
+        uint64_t bits;
+        memcpy( &bits, &value, sizeof( bits ) );
+
+        int biased_e = static_cast<int>( ( bits >> 52 ) & 0x7FF );
+        uint64_t significand = bits & ( ( uint64_t(1) << 52 ) - 1 );
+
+        if( biased_e != 0 ) {
+            f = significand + ( uint64_t(1) << 52 );
+            e = biased_e - 1075;
+        } else {
+            //subnormal
+            f = significand;
+            e = -1074;
+        }
+    }
+
+    DiyFp operator-( const DiyFp& rhs ) const {
+        return DiyFp( f - rhs.f, e );
+    }
+
+    //product rounded to the upper 64 bits
+    DiyFp operator*( const DiyFp& rhs ) const {
+        unsigned __int128 product = static_cast<unsigned __int128>( f )*rhs.f;
+        uint64_t high = static_cast<uint64_t>( product >> 64 );
+        uint64_t low = static_cast<uint64_t>( product );
+        return DiyFp( high + ( low >> 63 ), e + rhs.e + 64 );
+    }
+
+    DiyFp Normalize() const {
+        int shift = __builtin_clzll( f );
+        return DiyFp( f << shift, e - shift );
+    }
+};
+
+//10^k for k = -348, -340, ..., 340, as normalized DiyFp's
+static const uint64_t cached_powers_f[] = {
+    0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull,
+    0xcf42894a5dce35eaull, 0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull,
+    0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full, 0xbe5691ef416bd60cull,
+    0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+    0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull,
+    0xc21094364dfb5637ull, 0x9096ea6f3848984full, 0xd77485cb25823ac7ull,
+    0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull, 0xb23867fb2a35b28eull,
+    0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+    0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull,
+    0xb5b5ada8aaff80b8ull, 0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull,
+    0x964e858c91ba2655ull, 0xdff9772470297ebdull, 0xa6dfbd9fb8e5b88full,
+    0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+    0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull,
+    0xaa242499697392d3ull, 0xfd87b5f28300ca0eull, 0xbce5086492111aebull,
+    0x8cbccc096f5088ccull, 0xd1b71758e219652cull, 0x9c40000000000000ull,
+    0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+    0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull,
+    0x9f4f2726179a2245ull, 0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull,
+    0x83c7088e1aab65dbull, 0xc45d1df942711d9aull, 0x924d692ca61be758ull,
+    0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+    0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull,
+    0x952ab45cfa97a0b3ull, 0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull,
+    0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull, 0x88fcf317f22241e2ull,
+    0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+    0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull,
+    0x8bab8eefb6409c1aull, 0xd01fef10a657842cull, 0x9b10a4e5e9913129ull,
+    0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull, 0x80444b5e7aa7cf85ull,
+    0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+    0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull,
+};
+
+static const int16_t cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+};
+
+static const uint64_t powers_of_ten[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+    1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+    100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+    1000000000000000000ull, 10000000000000000000ull
+};
+
+//Find a cached power of ten c = 10^-K such that c x 2^e has a binary exponent in [-60, -32]
+inline DiyFp cached_power( int e, int& K ) {
+
+    double dk = ( -61 - e )*0.30102999566398114 + 347;
+    int k = static_cast<int>( dk );
+    if( dk - k > 0.0 ) {
+        k++;
+    }
+
+    uint index = static_cast<uint>( ( k >> 3 ) + 1 );
+    K = -( -348 + static_cast<int>( index << 3 ) );
+
+    return DiyFp( cached_powers_f[index], cached_powers_e[index] );
+}
+
+//Nudge the last digit towards w while the result stays inside the rounding interval
+inline void grisu_round( char* digits, int num_digits, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w ) {
+
+    while( rest < wp_w && delta - rest >= ten_kappa &&
+            ( rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w ) ) {
+        digits[num_digits - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+inline int count_digits( uint32_t n ) {
+    int count = 1;
+    while( n >= 10 ) {
+        n /= 10;
+        count++;
+    }
+    return count;
+}
+
+//Generate the shortest digits of any number in (Mp - delta, Mp), as close as possible to W
+inline void digit_gen( const DiyFp& W, const DiyFp& Mp, uint64_t delta, char* digits, int& num_digits, int& K ) {
+
+    const DiyFp one( uint64_t(1) << -Mp.e, Mp.e );
+    const DiyFp wp_w = Mp - W;
+
+    uint32_t p1 = static_cast<uint32_t>( Mp.f >> -one.e );
+    uint64_t p2 = Mp.f & ( one.f - 1 );
+
+    int kappa = count_digits( p1 );
+    num_digits = 0;
+
+    //integer part
+    while( kappa > 0 ) {
+        uint32_t power = static_cast<uint32_t>( powers_of_ten[kappa - 1] );
+        uint32_t d = p1/power;
+        p1 %= power;
+
+        if( d || num_digits ) {
+            digits[num_digits++] = static_cast<char>( '0' + d );
+        }
+        kappa--;
+
+        uint64_t rest = ( static_cast<uint64_t>( p1 ) << -one.e ) + p2;
+        if( rest <= delta ) {
+            K += kappa;
+            grisu_round( digits, num_digits, delta, rest, powers_of_ten[kappa] << -one.e, wp_w.f );
+            return;
+        }
+    }
+
+    //fractional part
+    for( ;; ) {
+        p2 *= 10;
+        delta *= 10;
+
+        char d = static_cast<char>( p2 >> -one.e );
+        if( d || num_digits ) {
+            digits[num_digits++] = static_cast<char>( '0' + d );
+        }
+        p2 &= one.f - 1;
+        kappa--;
+
+        if( p2 < delta ) {
+            K += kappa;
+            uint64_t unit = ( -kappa < 20 )? powers_of_ten[-kappa] : 0;
+            grisu_round( digits, num_digits, delta, p2, one.f, wp_w.f*unit );
+            return;
+        }
+    }
+}
+
+//Shortest digits d0 d1 ... of a finite, positive value, such that value = d0d1... x 10^K
+inline void grisu2( double value, char* digits, int& num_digits, int& K ) {
+
+    const DiyFp v( value );
+
+    //boundaries half way to the neighbouring doubles, with the same exponent
+    DiyFp w_plus = DiyFp( ( v.f << 1 ) + 1, v.e - 1 ).Normalize();
+    DiyFp w_minus = ( v.f == ( uint64_t(1) << 52 ) && v.e > -1074 )?
+                    DiyFp( ( v.f << 2 ) - 1, v.e - 2 ) : DiyFp( ( v.f << 1 ) - 1, v.e - 1 );
+    w_minus.f <<= w_minus.e - w_plus.e;
+    w_minus.e = w_plus.e;
+
+    const DiyFp c_mk = cached_power( w_plus.e, K );
+
+    const DiyFp W = v.Normalize()*c_mk;
+    DiyFp Wp = w_plus*c_mk;
+    DiyFp Wm = w_minus*c_mk;
+
+    //stay strictly inside the interval, to allow for rounding in the products above
+    Wm.f++;
+    Wp.f--;
+
+    digit_gen( W, Wp, Wp.f - Wm.f, digits, num_digits, K );
+}
+
+//Write the decimal number d0.d1d2... x 10^exponent into buffer,
+//in the same style as printf's %g
+inline size_t write_decimal( bool negative, const char* digits, int num_digits, int exponent, char* buffer ) {
+
+    char* out = buffer;
+
+    if( negative ) {
+        *out++ = '-';
+    }
+
+    if( exponent >= -5 && exponent < max_significant_digits ) {
+
+        if( exponent < 0 ) {
+            *out++ = '0';
+            *out++ = '.';
+            for( int i = -1 ; i > exponent ; i-- ) {
+                *out++ = '0';
+            }
+            memcpy( out, digits, num_digits );
+            out += num_digits;
+        } else {
+            for( int i = 0 ; i <= exponent ; i++ ) {
+                *out++ = ( i < num_digits )? digits[i] : '0';
+            }
+            if( num_digits > exponent + 1 ) {
+                *out++ = '.';
+                memcpy( out, digits + exponent + 1, num_digits - exponent - 1 );
+                out += num_digits - exponent - 1;
+            }
+        }
+
+    } else {
+
+        *out++ = digits[0];
+        if( num_digits > 1 ) {
+            *out++ = '.';
+            memcpy( out, digits + 1, num_digits - 1 );
+            out += num_digits - 1;
+        }
+
+        out += snprintf( out, 8, "e%c%02d", ( exponent < 0 )? '-' : '+', abs( exponent ) );
+    }
+
+    *out = '\0';
+    return out - buffer;
+}
+
+size_t format_double( double value, char* buffer ) {
+
+    if( !std::isfinite( value ) || value == 0.0 ) {
+        return snprintf( buffer, max_formatted_length, "%g", value );
+    }
+
+    bool negative = std::signbit( value );
+
+    char digits[max_significant_digits + 1];
+    int num_digits = 0;
+    int K = 0;
+    grisu2( std::fabs( value ), digits, num_digits, K );
+
+    return write_decimal( negative, digits, num_digits, K + num_digits - 1, buffer );
+}
+
+SpectrumExporter::SpectrumExporter( std::ostream& stream, ExportFormat format, size_t buffer_size ) :
+    stream( stream ),
+    format( format ),
+    buffer( std::max( buffer_size, 16*max_formatted_length ) ) {}
+
+SpectrumExporter::~SpectrumExporter() {
+    drain();
+}
+
+void SpectrumExporter::drain() {
+
+    if( used > 0 ) {
+        stream.write( buffer.data(), used );
+        used = 0;
+    }
+}
+
+void SpectrumExporter::reserve( size_t num_bytes ) {
+
+    if( used + num_bytes > buffer.size() ) {
+        drain();
+    }
+
+    if( num_bytes > buffer.size() ) {
+        buffer.resize( num_bytes );
+    }
+}
+
+void SpectrumExporter::write( double value ) {
+    write( &value, 1 );
+}
+
+void SpectrumExporter::write( double first, double second ) {
+    double values[2] = { first, second };
+    write( values, 2 );
+}
+
+void SpectrumExporter::write( const double* values, size_t num_values ) {
+
+    if( format == ExportFormat::Binary ) {
+        reserve( num_values*sizeof( double ) );
+        memcpy( buffer.data() + used, values, num_values*sizeof( double ) );
+        used += num_values*sizeof( double );
+        return;
+    }
+
+    //each value is followed by either a ',' or a '\n'
+    reserve( num_values*max_formatted_length );
+
+    for( size_t i = 0 ; i < num_values ; i++ ) {
+        used += format_double( values[i], buffer.data() + used );
+        buffer[used++] = ( i + 1 < num_values )? ',' : '\n';
+    }
+}
+
+bool SpectrumExporter::flush() {
+    drain();
+    stream.flush();
+    return stream.good();
+}
@@ -0,0 +1,116 @@
+#ifndef SPECTRUMEXPORTER_H
+#define SPECTRUMEXPORTER_H
+
+// C System-Headers
+//
+// C++ System headers
+#include <cstddef>     //size_t
+#include <vector>      //vector
+#include <ostream>     //std::ostream
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+//
+
+/*!
+ * \brief Number of characters format_double may write, including a terminating null.
+ */
+const size_t max_formatted_length = 32;
+
+/*!
+ * \brief Write a floating point number using as few significant digits as possible, while
+ * still guaranteeing that parse_double (or strtod) will decode exactly the same value.
+ *
+ * Digits are generated with integer arithmetic only (Grisu2), without calling into the C library.
+ * For a tiny fraction of values one more digit than strictly necessary is written.
+ *
+ * Numbers are written in fixed notation ("4012.5", "0.00125") when that is reasonably short,
+ * and scientific notation ("1.54e-23") otherwise. The "C" locale is always used.
+ *
+ * \param value
+ * The number to be written.
+ *
+ * \param buffer
+ * Where the number is written, must have room for at least max_formatted_length characters.
+ *
+ * \return
+ * The number of characters written, not counting the terminating null.
+ */
+size_t format_double( double value, char* buffer );
+
+/*!
+ * \brief Format that SpectrumExporter should write values in.
+ *
+ * CSV - Plain text, one row of comma separated values per line.\n
+ * Binary - Raw doubles in the byte order of the machine writing them, no separators.
+ */
+enum class ExportFormat {CSV, Binary};
+
+/*!
+ * \brief Object that writes large numbers of values to a stream through a single
+ * large buffer.
+ *
+ * Values are formatted straight into the buffer ( see format_double ), which is only handed
+ * to the stream once full, so a spectrum with millions of bins costs a handful of writes
+ * rather than one (flushed) write per bin.
+ *
+ * Anything still in the buffer is written when the exporter is destroyed, call flush()
+ * first to find out whether writing succeeded.
+ */
+class SpectrumExporter {
+
+  public:
+    /*!
+     * \param stream
+     * Where values are written, should be opened in binary mode if format is ExportFormat::Binary.
+     * Must outlive the exporter.
+     *
+     * \param format
+     * Whether values are written as text or raw doubles.
+     *
+     * \param buffer_size
+     * Number of bytes held in memory before they are written to stream.
+     */
+    SpectrumExporter( std::ostream& stream, ExportFormat format = ExportFormat::CSV, size_t buffer_size = 1 << 20 );
+    ~SpectrumExporter();
+
+    SpectrumExporter( const SpectrumExporter& ) = delete;
+    SpectrumExporter& operator=( const SpectrumExporter& ) = delete;
+
+    /*!
+     * \brief Write a row holding a single value.
+     */
+    void write( double value );
+
+    /*!
+     * \brief Write a row holding a pair of values, e.g. frequency and power.
+     */
+    void write( double first, double second );
+
+    /*!
+     * \brief Write a row of values.
+     */
+    void write( const double* values, size_t num_values );
+
+    /*!
+     * \brief Hand everything buffered so far to the stream and flush it.
+     *
+     * \return
+     * true if every value written so far reached the stream successfully.
+     */
+    bool flush();
+
+  private:
+    std::ostream& stream;
+    ExportFormat format;
+
+    std::vector<char> buffer;
+    size_t used = 0;
+
+    void reserve( size_t num_bytes );
+    void drain();
+};
+
+#endif // SPECTRUMEXPORTER_H
@@ -0,0 +1,24 @@
+// Header for this file
+#include "spectrumexpression.h"
+// C System-Headers
+//
+// C++ System headers
+#include <string>      //string
+#include <stdexcept>   //std::length_error
+// Boost Headers
+#include <boost/lexical_cast.hpp>  //lexical_cast
+// Miscellaneous Headers
+//
+//Project Specific Headers
+//
+
+void check_same_size( uint left_size, uint right_size ) {
+
+    if( left_size != right_size ) {
+        std::string err_mesg = "Spectra are not the same size ";
+        err_mesg += boost::lexical_cast<std::string> (left_size);
+        err_mesg += " vs ";
+        err_mesg += boost::lexical_cast<std::string> (right_size);
+        throw std::length_error(err_mesg);
+    }
+}
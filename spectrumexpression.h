@@ -0,0 +1,398 @@
+#ifndef SPECTRUMEXPRESSION_H
+#define SPECTRUMEXPRESSION_H
+
+// C System-Headers
+#include <sys/types.h> //uint
+// C++ System headers
+#include <vector>      //vector
+#include <type_traits> //enable_if, decay, is_base_of
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "spectrumview.h"
+
+/*! \file
+ * \brief Lazy arithmetic on SingleSpectrum objects.
+ *
+ * Adding, subtracting or multiplying spectra (or spectra and vectors, or spectra and scalars)
+ * does not compute anything straight away, but builds a small expression object that records
+ * the operation. The whole expression is evaluated in a single pass when it is assigned to a
+ * SingleSpectrum, so a formula such as
+ *
+ * \f{verbatim}{
+ *   SingleSpectrum model = ( background_a + background_b )*0.5 - baseline;
+ * \f}
+ *
+ * allocates one power list and one list of uncertainties, no matter how many terms it has.
+ *
+ * Uncertainties are propagated assuming operands are independent, i.e.
+ * \f$ \sigma_{a \pm b}^2 = \sigma_a^2 + \sigma_b^2 \f$ and
+ * \f$ \sigma_{ab}^2 = b^2\sigma_a^2 + a^2\sigma_b^2 \f$. Vectors and scalars are exact, so
+ * adding one leaves uncertainties unchanged and multiplying by one scales them. Spectra whose
+ * uncertainties have not been populated are also treated as exact. Header information
+ * (frequencies, Q, units etc.) is taken from the left-most spectrum.
+ *
+ * Expressions refer to their operands rather than copying them, so an expression must be
+ * assigned to a SingleSpectrum before any of its operands change or go out of scope. In
+ * particular, do not store one with auto.
+ */
+
+class SingleSpectrum;
+
+/*!
+ * \brief Base of every expression, see SingleSpectrum::operator=.
+ */
+template <typename Derived>
+struct SpectrumExpression {
+    const Derived& derived() const {
+        return static_cast<const Derived&>( *this );
+    }
+};
+
+/*!
+ * \brief Leaf of an expression referring to the values of a SingleSpectrum.
+ */
+class SpectrumTerm : public SpectrumExpression<SpectrumTerm> {
+
+  public:
+    /*!
+     * \brief Decodes the power values of spectrum if need be, see SingleSpectrum::Materialize().
+     */
+    SpectrumTerm( const SingleSpectrum& spectrum ) : spectrum( &spectrum ), values( spectrum ) {}
+
+    uint size() const {
+        return values.size();
+    }
+
+    double power( uint i ) const {
+        return values.power( i );
+    }
+
+    double variance( uint i ) const {
+        return values.uncertainty( i )*values.uncertainty( i );
+    }
+
+    bool has_uncertainties() const {
+        return values.has_uncertainties();
+    }
+
+    const SingleSpectrum& prototype() const {
+        return *spectrum;
+    }
+
+  private:
+    const SingleSpectrum* spectrum;
+    SpectrumView values;
+};
+
+/*!
+ * \brief Leaf of an expression referring to a std::vector, which is treated as exact.
+ */
+class VectorTerm {
+
+  public:
+    VectorTerm( const std::vector<double>& values ) :
+        values( values.data() ),
+        num_points( values.size() ) {}
+
+    uint size() const {
+        return num_points;
+    }
+
+    double power( uint i ) const {
+        return values[i];
+    }
+
+    double variance( uint ) const {
+        return 0.0;
+    }
+
+    bool has_uncertainties() const {
+        return false;
+    }
+
+  private:
+    const double* values;
+    uint num_points;
+};
+
+/*!
+ * \throws std::length_error
+ * Thrown if the two operands of a binary expression are not the same size.
+ */
+void check_same_size( uint left_size, uint right_size );
+
+template <typename L, typename R>
+class SumExpression : public SpectrumExpression< SumExpression<L, R> > {
+
+  public:
+    SumExpression( const L& left, const R& right ) : left( left ), right( right ) {
+        check_same_size( left.size(), right.size() );
+    }
+
+    uint size() const {
+        return left.size();
+    }
+
+    double power( uint i ) const {
+        return left.power( i ) + right.power( i );
+    }
+
+    double variance( uint i ) const {
+        return left.variance( i ) + right.variance( i );
+    }
+
+    bool has_uncertainties() const {
+        return left.has_uncertainties() || right.has_uncertainties();
+    }
+
+    const SingleSpectrum& prototype() const {
+        return left.prototype();
+    }
+
+  private:
+    L left;
+    R right;
+};
+
+template <typename L, typename R>
+class DifferenceExpression : public SpectrumExpression< DifferenceExpression<L, R> > {
+
+  public:
+    DifferenceExpression( const L& left, const R& right ) : left( left ), right( right ) {
+        check_same_size( left.size(), right.size() );
+    }
+
+    uint size() const {
+        return left.size();
+    }
+
+    double power( uint i ) const {
+        return left.power( i ) - right.power( i );
+    }
+
+    double variance( uint i ) const {
+        return left.variance( i ) + right.variance( i );
+    }
+
+    bool has_uncertainties() const {
+        return left.has_uncertainties() || right.has_uncertainties();
+    }
+
+    const SingleSpectrum& prototype() const {
+        return left.prototype();
+    }
+
+  private:
+    L left;
+    R right;
+};
+
+template <typename L, typename R>
+class ProductExpression : public SpectrumExpression< ProductExpression<L, R> > {
+
+  public:
+    ProductExpression( const L& left, const R& right ) : left( left ), right( right ) {
+        check_same_size( left.size(), right.size() );
+    }
+
+    uint size() const {
+        return left.size();
+    }
+
+    double power( uint i ) const {
+        return left.power( i )*right.power( i );
+    }
+
+    double variance( uint i ) const {
+        double left_power = left.power( i );
+        double right_power = right.power( i );
+
+        return right_power*right_power*left.variance( i ) + left_power*left_power*right.variance( i );
+    }
+
+    bool has_uncertainties() const {
+        return left.has_uncertainties() || right.has_uncertainties();
+    }
+
+    const SingleSpectrum& prototype() const {
+        return left.prototype();
+    }
+
+  private:
+    L left;
+    R right;
+};
+
+template <typename E>
+class ShiftExpression : public SpectrumExpression< ShiftExpression<E> > {
+
+  public:
+    ShiftExpression( const E& operand, double offset ) : operand( operand ), offset( offset ) {}
+
+    uint size() const {
+        return operand.size();
+    }
+
+    double power( uint i ) const {
+        return operand.power( i ) + offset;
+    }
+
+    double variance( uint i ) const {
+        return operand.variance( i );
+    }
+
+    bool has_uncertainties() const {
+        return operand.has_uncertainties();
+    }
+
+    const SingleSpectrum& prototype() const {
+        return operand.prototype();
+    }
+
+  private:
+    E operand;
+    double offset;
+};
+
+template <typename E>
+class ScaleExpression : public SpectrumExpression< ScaleExpression<E> > {
+
+  public:
+    ScaleExpression( const E& operand, double factor ) : operand( operand ), factor( factor ) {}
+
+    uint size() const {
+        return operand.size();
+    }
+
+    double power( uint i ) const {
+        return operand.power( i )*factor;
+    }
+
+    double variance( uint i ) const {
+        return operand.variance( i )*factor*factor;
+    }
+
+    bool has_uncertainties() const {
+        return operand.has_uncertainties();
+    }
+
+    const SingleSpectrum& prototype() const {
+        return operand.prototype();
+    }
+
+  private:
+    E operand;
+    double factor;
+};
+
+/*!
+ * \brief Decide how an argument of an arithmetic operator takes part in an expression.
+ *
+ * Spectra may only be used as lvalues, so that an expression never refers to a temporary.
+ */
+template <typename T, typename D = typename std::decay<T>::type>
+struct spectrum_operand {
+    static const bool is_spectrum = std::is_base_of< SpectrumExpression<D>, D >::value;
+    static const bool is_vector = false;
+    typedef D type;
+
+    static type make( const D& expression ) {
+        return expression;
+    }
+};
+
+template <typename T>
+struct spectrum_operand<T, SingleSpectrum> {
+    static const bool is_spectrum = std::is_lvalue_reference<T>::value;
+    static const bool is_vector = false;
+    typedef SpectrumTerm type;
+
+    static type make( const SingleSpectrum& spectrum ) {
+        return SpectrumTerm( spectrum );
+    }
+};
+
+template <typename T>
+struct spectrum_operand<T, std::vector<double> > {
+    static const bool is_spectrum = false;
+    static const bool is_vector = std::is_lvalue_reference<T>::value;
+    typedef VectorTerm type;
+
+    static type make( const std::vector<double>& values ) {
+        return VectorTerm( values );
+    }
+};
+
+template <typename A, typename B>
+struct binary_spectrum_operands {
+    static const bool value = spectrum_operand<A>::is_spectrum &&
+                              ( spectrum_operand<B>::is_spectrum || spectrum_operand<B>::is_vector );
+};
+
+/*!
+ * \throws std::length_error
+ * Thrown if the spectra (or spectrum and vector) are not the same size.
+ */
+template <typename A, typename B>
+typename std::enable_if< binary_spectrum_operands<A, B>::value,
+         SumExpression< typename spectrum_operand<A>::type, typename spectrum_operand<B>::type > >::type
+operator+ ( A&& a, B&& b ) {
+
+    typedef SumExpression< typename spectrum_operand<A>::type, typename spectrum_operand<B>::type > Result;
+    return Result( spectrum_operand<A>::make( a ), spectrum_operand<B>::make( b ) );
+}
+
+/*!
+ * \throws std::length_error
+ * Thrown if the spectra (or spectrum and vector) are not the same size.
+ */
+template <typename A, typename B>
+typename std::enable_if< binary_spectrum_operands<A, B>::value,
+         DifferenceExpression< typename spectrum_operand<A>::type, typename spectrum_operand<B>::type > >::type
+operator- ( A&& a, B&& b ) {
+
+    typedef DifferenceExpression< typename spectrum_operand<A>::type, typename spectrum_operand<B>::type > Result;
+    return Result( spectrum_operand<A>::make( a ), spectrum_operand<B>::make( b ) );
+}
+
+/*!
+ * \throws std::length_error
+ * Thrown if the spectra (or spectrum and vector) are not the same size.
+ */
+template <typename A, typename B>
+typename std::enable_if< binary_spectrum_operands<A, B>::value,
+         ProductExpression< typename spectrum_operand<A>::type, typename spectrum_operand<B>::type > >::type
+operator* ( A&& a, B&& b ) {
+
+    typedef ProductExpression< typename spectrum_operand<A>::type, typename spectrum_operand<B>::type > Result;
+    return Result( spectrum_operand<A>::make( a ), spectrum_operand<B>::make( b ) );
+}
+
+template <typename A>
+typename std::enable_if< spectrum_operand<A>::is_spectrum,
+         ShiftExpression< typename spectrum_operand<A>::type > >::type
+operator+ ( A&& a, double scalar ) {
+
+    return ShiftExpression< typename spectrum_operand<A>::type >( spectrum_operand<A>::make( a ), scalar );
+}
+
+template <typename A>
+typename std::enable_if< spectrum_operand<A>::is_spectrum,
+         ShiftExpression< typename spectrum_operand<A>::type > >::type
+operator- ( A&& a, double scalar ) {
+
+    return ShiftExpression< typename spectrum_operand<A>::type >( spectrum_operand<A>::make( a ), -scalar );
+}
+
+template <typename A>
+typename std::enable_if< spectrum_operand<A>::is_spectrum,
+         ScaleExpression< typename spectrum_operand<A>::type > >::type
+operator* ( A&& a, double scalar ) {
+
+    return ScaleExpression< typename spectrum_operand<A>::type >( spectrum_operand<A>::make( a ), scalar );
+}
+
+#endif // SPECTRUMEXPRESSION_H
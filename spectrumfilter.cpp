@@ -25,21 +25,11 @@
 #include <omp.h>//OpenMP pragmas
 //Project Specific Headers
 #include "singlespectrum.h"
+#include "spectrumstatistics.h"
+#include "spectrumarena.h"
 
-//sum all enteries in a vector, with optional parameter of raising each entry to a power
-//used by Standard Deviation function
-double sum(std::vector<double>& data_list,double exponent) {
-
-    double tot = 0;
-    for ( auto& val : data_list ) {
-        tot+= std::pow( val, exponent );
-    }
-
-    return tot;
-}
-
-inline double norm(std::vector<double>& data_list ) {
-    return std::sqrt(sum(data_list,2.0));
+inline double norm( const ScratchList& data_list ) {
+    return statistics( data_list.data(), data_list.size() ).norm();
 }
 
 //define a gaussian function with standard deviation sigma and a mean value of zero
@@ -48,8 +38,8 @@ inline double gaussian(double x, double sigma) {
     return 1.0/(std::sqrt(M_PI_2)*sigma)*std::exp( -0.5 *std::pow(x/sigma,2.0));
 }
 
-std::vector<double> Normalize(std::vector<double>& data_list) {
-    double norm_factor=std::sqrt(sum(data_list,2));
+ScratchList Normalize(ScratchList& data_list) {
+    double norm_factor=norm(data_list);
 
     for(unsigned int i = 0; i<data_list.size(); i++) {
         data_list.at(i)=data_list.at(i)/norm_factor;
@@ -59,10 +49,10 @@ std::vector<double> Normalize(std::vector<double>& data_list) {
 
 //generate a gaussian kernel of radius 'r', suitable for convolutions
 //kernel will have a standard deviation of r/2.
-std::vector<double> GaussKernel(int r) {
+ScratchList GaussKernel(int r) {
 
     double sigma = static_cast<double>(r)/2.0;
-    std::vector<double> vals;
+    ScratchList vals;
     for( int i = -r; i<= r ; i ++) {
         vals.push_back(gaussian(i,sigma));
     }
@@ -73,9 +63,9 @@ std::vector<double> GaussKernel(int r) {
 
 //generate a gaussian kernel of radius 'r', suitable for convolutions
 //kernel will have a standard deviation set by user
-std::vector<double> GaussKernel( int r, double sigma ) {
+ScratchList GaussKernel( int r, double sigma ) {
 
-    std::vector<double> vals;
+    ScratchList vals;
     for( int i = -r; i<= r ; i ++) {
         vals.push_back(gaussian(i,sigma));
     }
@@ -85,9 +75,9 @@ std::vector<double> GaussKernel( int r, double sigma ) {
 }
 
 
-std::vector<double> UnsharpKernel( int radius, double sigma ) {
+ScratchList UnsharpKernel( int radius, double sigma ) {
 
-    std::vector<double> kernel( 2*radius + 1 );
+    ScratchList kernel( 2*radius + 1 );
 
     for( int i = -radius; i <= -1 ; i ++) {
         kernel.push_back( -1.0*gaussian( i, sigma ) );
@@ -111,9 +101,9 @@ inline double special_sinc( const double x, double f_t ) {
     }
 }
 
-std::vector< double > sinc_kernel( int radius, double cutoff_frequency, double sample_frequency ) {
+ScratchList sinc_kernel( int radius, double cutoff_frequency, double sample_frequency ) {
 
-    std::vector<double> vals( 2*radius + 1 );
+    ScratchList vals( 2*radius + 1 );
     double f_t = cutoff_frequency/sample_frequency;
 
     for( int i = -radius; i <= radius ; i ++) {
@@ -127,8 +117,8 @@ std::vector< double > sinc_kernel( int radius, double cutoff_frequency, double s
 
 }
 
-template <typename T>
-std::vector<T> LinearConvolve( std::vector<T>& signal, std::vector<T>& kernel) {
+template <typename List>
+List LinearConvolve( List& signal, List& kernel) {
 
     int kernel_size = kernel.size();
     int half_k_size = (kernel_size - 1 )/2;
@@ -136,7 +126,7 @@ std::vector<T> LinearConvolve( std::vector<T>& signal, std::vector<T>& kernel) {
     int signal_size = signal.size();
     int signal_max_index = signal_size - 1;
 
-    std::vector<T> output( signal_size , 0);
+    List output( signal_size , 0);
 
     #pragma omp parallel for
     for ( int i = 0 ; i < signal_size ; i++ ) {
@@ -171,13 +161,13 @@ std::vector<T> LinearConvolve( std::vector<T>& signal, std::vector<T>& kernel) {
 
 //Convolve the input list 'data_list' with a gaussian kernel with user defined radius
 //serves as a low-pass filter that surpresses noise.
-std::vector<double> GaussBlur(std::vector<double>& data_list, uint radius) {
+ScratchList GaussBlur(ScratchList& data_list, uint radius) {
 
     auto gauss_matrix = GaussKernel( radius );
     return LinearConvolve( data_list, gauss_matrix );
 }
 
-std::vector<double> Unsharp( std::vector<double>& data_list, uint radius, double sigma ) {
+ScratchList Unsharp( ScratchList& data_list, uint radius, double sigma ) {
 
     auto gauss_matrix = GaussKernel( radius, sigma );
     auto blurred_mat = LinearConvolve( data_list, gauss_matrix );
@@ -206,7 +196,7 @@ std::vector<double> Unsharp( std::vector<double>& data_list, uint radius, double
     return data_list;
 }
 
-std::vector<double> SincFilter( std::vector<double>& data_list, uint radius, double cutoff_frequency, double sample_frequency ) {
+ScratchList SincFilter( ScratchList& data_list, uint radius, double cutoff_frequency, double sample_frequency ) {
 
     auto sinc_matrix = sinc_kernel( radius, cutoff_frequency, sample_frequency );
     auto sharpened_signal = LinearConvolve( data_list, sinc_matrix );
@@ -248,32 +238,14 @@ std::vector<double> SincFilter( std::vector<double>& data_list, uint radius, dou
 //    return sharpened_signal;
 //}
 
-double mean( std::vector< double >& data_list ) {
-    //compute mean value of data set
-    double sum_x = sum( data_list, 1.0 );
-    double n = static_cast<double>( data_list.size() );
-    return sum_x/n;
-}
-
-double std_dev ( std::vector<double> &data_list ) {
-
-    //compute mean value of data set
-    double sum_x = sum( data_list,1.0 );
-    double n = static_cast<double>( data_list.size() );
-    double mean = sum_x/n;
-
-    //compute variance taking into account Bessel's correction i.e. n/(n-1)
-    double sum_x2 = sum( data_list, 2.0 );
-    double sigma_sqr = sum_x2/( n - 1.0 )-n/( n-1.0 )*std::pow( mean, 2.0 );
-
-    //return square root of variance
-    return std::sqrt(sigma_sqr);
-}
-
 std::pair< uint, double > AutoOptimize( SingleSpectrum& spec, uint max_radius, double sample_frequency ) {
+    spec.Materialize();
+
+    //every scratch list below is freed in one go on return
+    ArenaScope scratch_scope;
 
     double target = 1.0/sqrt( static_cast<double>( spec.size() ) );
-    std::vector<double> spec_data = spec.sa_power_list;
+    ScratchList spec_data( spec.sa_power_list.begin(), spec.sa_power_list.end() );
     Normalize( spec_data );
 
     double smallest_delta = std::numeric_limits<double>::max();
@@ -289,9 +261,12 @@ std::pair< uint, double > AutoOptimize( SingleSpectrum& spec, uint max_radius, d
 
             std::cout << "Trying parameters: ("<< radius_it << "," << sigma_f <<")" << std::endl;
 
+            //each candidate reuses the memory of the one before it
+            ArenaScope candidate_scope;
             auto test_signal = Unsharp( spec_data, radius_it, sigma_f );
 
-            double aim = mean( test_signal )/std_dev( test_signal );
+            auto test_statistics = statistics( test_signal.data(), test_signal.size() );
+            double aim = test_statistics.mean()/test_statistics.std_dev();
 
             double delta = std::abs( target - aim );
 
@@ -355,9 +330,17 @@ std::pair< uint, double > AutoOptimize( SingleSpectrum& spec, uint max_radius, d
 
 
 void GaussianFilter( SingleSpectrum& spec, uint radius ) {
-    spec.sa_power_list = GaussBlur(spec.sa_power_list, radius);
+    spec.Materialize();
+    ArenaScope scratch_scope;
+    ScratchList spec_data( spec.sa_power_list.begin(), spec.sa_power_list.end() );
+    spec_data = GaussBlur(spec_data, radius);
+    spec.sa_power_list.assign( spec_data.begin(), spec_data.end() );
 }
 
 void UnsharpMask( SingleSpectrum& spec, uint radius, double sigma ) {
-    spec.sa_power_list = Unsharp( spec.sa_power_list, radius, sigma );
+    spec.Materialize();
+    ArenaScope scratch_scope;
+    ScratchList spec_data( spec.sa_power_list.begin(), spec.sa_power_list.end() );
+    spec_data = Unsharp( spec_data, radius, sigma );
+    spec.sa_power_list.assign( spec_data.begin(), spec_data.end() );
 }
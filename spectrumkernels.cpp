@@ -0,0 +1,150 @@
+// Header for this file
+#include "spectrumkernels.h"
+// C System-Headers
+//
+// C++ System headers
+#include <cstddef>     //size_t
+#include <algorithm>   //std::min, std::max
+#include <limits>      //std::numeric_limits
+// Boost Headers
+//
+// Miscellaneous Headers
+#include <omp.h>  //OpenMP pragmas
+//Project Specific Headers
+#include "physicsfunctions.h"
+
+//Lists at least this long are rebinned by several threads
+const size_t parallel_rebin_points = 1 << 16;
+
+void scale( PowerList& values, double factor ) {
+
+    spectrum_value* x = values.data();
+    const size_t n = values.size();
+
+    #pragma omp simd aligned( x : power_list_alignment )
+    for( size_t i = 0 ; i < n ; i++ ) {
+        x[i] *= factor;
+    }
+}
+
+void shift( PowerList& values, double offset ) {
+
+    spectrum_value* x = values.data();
+    const size_t n = values.size();
+
+    #pragma omp simd aligned( x : power_list_alignment )
+    for( size_t i = 0 ; i < n ; i++ ) {
+        x[i] += offset;
+    }
+}
+
+void scale_shift( PowerList& values, double factor, double offset ) {
+
+    spectrum_value* x = values.data();
+    const size_t n = values.size();
+
+    #pragma omp simd aligned( x : power_list_alignment )
+    for( size_t i = 0 ; i < n ; i++ ) {
+        x[i] = x[i]*factor + offset;
+    }
+}
+
+void add( PowerList& values, const double* other ) {
+
+    spectrum_value* x = values.data();
+    const size_t n = values.size();
+
+    #pragma omp simd aligned( x : power_list_alignment )
+    for( size_t i = 0 ; i < n ; i++ ) {
+        x[i] += other[i];
+    }
+}
+
+void subtract( PowerList& values, const double* other ) {
+
+    spectrum_value* x = values.data();
+    const size_t n = values.size();
+
+    #pragma omp simd aligned( x : power_list_alignment )
+    for( size_t i = 0 ; i < n ; i++ ) {
+        x[i] -= other[i];
+    }
+}
+
+void max_rebin( const PowerList& values, uint points_per_bin, PowerList& binned ) {
+
+    const size_t num_bins = values.size()/points_per_bin;
+    binned.resize( num_bins );
+
+    const spectrum_value* x = values.data();
+    spectrum_value* y = binned.data();
+
+    #pragma omp parallel for if( values.size() >= parallel_rebin_points )
+    for( size_t j = 0 ; j < num_bins ; j++ ) {
+
+        const spectrum_value* bin = x + j*points_per_bin;
+        spectrum_value highest = bin[0];
+
+        for( uint k = 1 ; k < points_per_bin ; k++ ) {
+            highest = std::max( highest, bin[k] );
+        }
+
+        y[j] = highest;
+    }
+}
+
+void multiply( PowerList& values, const double* other ) {
+
+    spectrum_value* x = values.data();
+    const size_t n = values.size();
+
+    #pragma omp simd aligned( x : power_list_alignment )
+    for( size_t i = 0 ; i < n ; i++ ) {
+        x[i] *= other[i];
+    }
+}
+
+void quantize( const PowerList& values, QuantizedList& codes, double& offset, double& step ) {
+
+    const spectrum_value* x = values.data();
+    const size_t n = values.size();
+
+    double lowest = ( n > 0 )? x[0] : 0.0;
+    double highest = lowest;
+
+    #pragma omp simd aligned( x : power_list_alignment ) reduction( min:lowest ) reduction( max:highest )
+    for( size_t i = 0 ; i < n ; i++ ) {
+        lowest = std::min<double>( lowest, x[i] );
+        highest = std::max<double>( highest, x[i] );
+    }
+
+    const double largest_code = std::numeric_limits<uint16_t>::max();
+
+    offset = lowest;
+    step = ( highest > lowest )? ( highest - lowest )/largest_code : 1.0;
+
+    const double inverse_step = 1.0/step;
+
+    codes.resize( n );
+    uint16_t* q = codes.data();
+
+    #pragma omp simd aligned( x, q : power_list_alignment )
+    for( size_t i = 0 ; i < n ; i++ ) {
+        double code = std::min( ( x[i] - offset )*inverse_step + 0.5, largest_code );
+        q[i] = static_cast<uint16_t>( code );
+    }
+}
+
+void dequantize_dbm_to_watts( const QuantizedList& codes, double offset, double step, PowerList& values ) {
+
+    const uint16_t* q = codes.data();
+    const size_t n = codes.size();
+
+    values.resize( n );
+    spectrum_value* x = values.data();
+
+    #pragma omp simd aligned( x, q : power_list_alignment )
+    for( size_t i = 0 ; i < n ; i++ ) {
+        x[i] = dbm_to_watts( offset + step*q[i] );
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef SPECTRUMKERNELS_H
+#define SPECTRUMKERNELS_H
+
+// C System-Headers
+//
+// C++ System headers
+#include <cstddef>     //size_t
+#include <sys/types.h> //uint
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "alignedallocator.h"
+
+/*! \file
+ * \brief Element-wise kernels used by SingleSpectrum arithmetic and unit conversions.
+ *
+ * Each kernel is a single pass over its data, vectorized with OpenMP simd
+ * directives and told that PowerList buffers are aligned to power_list_alignment, so
+ * the compiler emits aligned SIMD loads and stores without any scalar peeling.
+ * The order of floating point operations on each element is exactly that of the
+ * scalar loops they replace, so results are identical. Arithmetic is done in double
+ * even when values are stored as float, see spectrum_value.
+ *
+ * Where a kernel takes a second operand as a plain pointer, that pointer must
+ * point to at least values.size() elements but need not be aligned.
+ */
+
+/*!
+ * \brief values[i] *= factor
+ */
+void scale( PowerList& values, double factor );
+
+/*!
+ * \brief values[i] += offset
+ */
+void shift( PowerList& values, double offset );
+
+/*!
+ * \brief values[i] = values[i]*factor + offset
+ */
+void scale_shift( PowerList& values, double factor, double offset );
+
+/*!
+ * \brief values[i] += other[i]
+ */
+void add( PowerList& values, const double* other );
+
+/*!
+ * \brief values[i] -= other[i]
+ */
+void subtract( PowerList& values, const double* other );
+
+/*!
+ * \brief values[i] *= other[i]
+ */
+void multiply( PowerList& values, const double* other );
+
+/*!
+ * \brief binned[j] = largest of values[j*points_per_bin] to values[(j+1)*points_per_bin - 1]
+ *
+ * Points at the end that do not fill a whole bin are dropped, binned is resized to
+ * values.size()/points_per_bin. Long lists are binned by several threads.
+ */
+void max_rebin( const PowerList& values, uint points_per_bin, PowerList& binned );
+
+/*!
+ * \brief Store values as 16 bit fixed point, values[i] ~ offset + step*codes[i]
+ *
+ * offset and step are chosen from the smallest and largest of the values, so that their whole
+ * range is covered and every value is within step/2 of what it decodes to.
+ */
+void quantize( const PowerList& values, QuantizedList& codes, double& offset, double& step );
+
+/*!
+ * \brief values[i] = dbm_to_watts( offset + step*codes[i] ), decoding power values stored by
+ * quantize() and converting them from dBm to Watts in the same pass.
+ */
+void dequantize_dbm_to_watts( const QuantizedList& codes, double offset, double step, PowerList& values );
+
+#endif // SPECTRUMKERNELS_H
@@ -0,0 +1,101 @@
+// Header for this file
+#include "spectrumpyramid.h"
+// C System-Headers
+//
+// C++ System headers
+#include <cmath>       //floor, ceil
+#include <string>      //string
+#include <stdexcept>   //std::invalid_argument, std::out_of_range
+#include <utility>     //std::move
+#include <algorithm>   //std::min, std::max
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+//
+
+SpectrumPyramid::SpectrumPyramid( SingleSpectrum base ) {
+
+    pyramid.push_back( std::move( base ) );
+
+    //each level is half the size of the one below, so this is about as much work
+    //as rebinning the original spectrum once
+    while( pyramid.back().size() > 1 ) {
+        auto next = pyramid.back().rebinned( 2 );
+        pyramid.push_back( std::move( next ) );
+    }
+}
+
+uint SpectrumPyramid::levels() const {
+    return pyramid.size();
+}
+
+const SingleSpectrum& SpectrumPyramid::Level( uint level ) const {
+    return pyramid.at( level );
+}
+
+SingleSpectrum SpectrumPyramid::Rebinned( uint points_per_bin ) const {
+
+    if( points_per_bin == 0 ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nBins must hold at least one point.";
+        throw std::invalid_argument(err_mesg);
+    }
+
+    //coarsest level whose bins fit a whole number of times into points_per_bin
+    uint level = 0;
+    while( level + 1 < levels() && points_per_bin % ( 2u << level ) == 0 ) {
+        level++;
+    }
+
+    return pyramid[level].rebinned( points_per_bin >> level );
+}
+
+SingleSpectrum SpectrumPyramid::Window( double min_freq, double max_freq, uint max_points ) const {
+
+    if( max_points == 0 || min_freq >= max_freq ||
+            max_freq <= pyramid[0].min_freq() || min_freq >= pyramid[0].max_freq() ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nWindow must overlap the spectrum and hold at least one point.";
+        throw std::invalid_argument(err_mesg);
+    }
+
+    //finest level that shows the window in at most max_points points
+    for( uint level = 0; level < levels(); level++ ) {
+
+        const auto& spec = pyramid[level];
+        spec.Materialize();
+
+        double bin_width = spec.bin_width();
+        double first = std::floor( ( min_freq - spec.min_freq() )/bin_width );
+        double last = std::ceil( ( max_freq - spec.min_freq() )/bin_width );
+
+        uint first_bin = static_cast<uint>( std::max( first, 0.0 ) );
+        uint last_bin = static_cast<uint>( std::min( last, static_cast<double>( spec.size() ) ) );
+
+        if( last_bin - first_bin > max_points && level + 1 < levels() ) {
+            continue;
+        }
+
+        uint num_points = last_bin - first_bin;
+
+        SingleSpectrum window( 0u );
+        window.CopyHeader( spec );
+        window.center_frequency = spec.bin_start_freq( first_bin ) + 0.5*num_points*bin_width;
+        window.frequency_span = num_points*bin_width;
+
+        window.sa_power_list.assign( spec.sa_power_list.begin() + first_bin,
+                                     spec.sa_power_list.begin() + last_bin );
+
+        if( spec.uncertainties.size() == spec.size() ) {
+            window.uncertainties.assign( spec.uncertainties.begin() + first_bin,
+                                         spec.uncertainties.begin() + last_bin );
+        }
+
+        return window;
+    }
+
+    //not reached, the last level always has at most one point
+    return pyramid.back();
+}
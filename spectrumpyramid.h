@@ -0,0 +1,75 @@
+#ifndef SPECTRUMPYRAMID_H
+#define SPECTRUMPYRAMID_H
+
+// C System-Headers
+#include <sys/types.h> //uint
+// C++ System headers
+#include <vector>      //vector
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "singlespectrum.h"
+
+/*!
+ * \brief A spectrum (usually a Grand Spectrum or Limits) together with copies of it
+ * rebinned to every power-of-two bin size, using the same rule as SingleSpectrum::rebinned().
+ *
+ * Level 0 is the spectrum itself, level l combines 2^l points per bin, each level being built
+ * from the one below it. Since the largest of a set of points is the largest of the largest
+ * of each half, every level is exactly what rebinning the original spectrum would give.
+ *
+ * Any other bin size, or a zoomed-in window for plotting, is then served from the nearest level
+ * rather than rebinning the full spectrum (or rebuilding the Grand Spectrum) again.
+ * All levels together use about twice the memory of the original spectrum.
+ */
+class SpectrumPyramid {
+
+  public:
+    /*!
+     * \param base
+     * The spectrum at full resolution. Pass an rvalue (e.g. the result of
+     * Spectrum::GrandSpectrum()) to avoid copying it.
+     */
+    SpectrumPyramid( SingleSpectrum base );
+
+    /*!
+     * \brief Get the number of levels, level levels() - 1 has a single point.
+     */
+    uint levels() const;
+
+    /*!
+     * \brief Get the spectrum rebinned to 2^level points per bin.
+     *
+     * \throws std::out_of_range
+     * Thrown if level >= levels()
+     */
+    const SingleSpectrum& Level( uint level ) const;
+
+    /*!
+     * \brief Get the spectrum rebinned to any number of points per bin, the result is identical
+     * to calling SingleSpectrum::rebinned( points_per_bin ) on the original spectrum.
+     *
+     * Starts from the coarsest level whose bin size divides points_per_bin, so for
+     * points_per_bin = 600 = 8*75 only an eighth of the original points are visited.
+     *
+     * \throws std::invalid_argument
+     * Thrown if points_per_bin is zero.
+     */
+    SingleSpectrum Rebinned( uint points_per_bin ) const;
+
+    /*!
+     * \brief Get the part of the spectrum between two frequencies, at the finest level that
+     * shows it in at most max_points points, e.g. for a zoomed in plot.
+     *
+     * \throws std::invalid_argument
+     * Thrown if the frequencies do not overlap the spectrum or max_points is zero.
+     */
+    SingleSpectrum Window( double min_freq, double max_freq, uint max_points ) const;
+
+  private:
+    std::vector<SingleSpectrum> pyramid;
+};
+
+#endif // SPECTRUMPYRAMID_H
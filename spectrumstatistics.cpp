@@ -0,0 +1,101 @@
+// Header for this file
+#include "spectrumstatistics.h"
+// C System-Headers
+//
+// C++ System headers
+#include <cmath>       //sqrt
+// Boost Headers
+//
+// Miscellaneous Headers
+#include <omp.h>  //OpenMP pragmas
+//Project Specific Headers
+//
+
+//Blocks this short are summed directly, longer lists are split in two
+const size_t statistics_block_points = 128;
+
+double SampleStatistics::mean() const {
+    return sum/static_cast<double>( count );
+}
+
+double SampleStatistics::variance() const {
+    return squared_deviations/( static_cast<double>( count ) - 1.0 );
+}
+
+double SampleStatistics::std_dev() const {
+    return std::sqrt( variance() );
+}
+
+double SampleStatistics::norm() const {
+    return std::sqrt( sum_of_squares );
+}
+
+template <typename T>
+SampleStatistics block_statistics( const T* values, size_t count ) {
+
+    //sums of differences from the first value stay small, so the squared deviations
+    //may be found from them without cancellation
+    const double reference = values[0];
+
+    double sum_x = 0.0;
+    double sum_x2 = 0.0;
+    double sum_d = 0.0;
+    double sum_d2 = 0.0;
+
+    #pragma omp simd reduction( +:sum_x, sum_x2, sum_d, sum_d2 )
+    for( size_t i = 0 ; i < count ; i++ ) {
+        double x = values[i];
+        double d = x - reference;
+
+        sum_x += x;
+        sum_x2 += x*x;
+        sum_d += d;
+        sum_d2 += d*d;
+    }
+
+    return SampleStatistics { count, sum_x, sum_x2, sum_d2 - sum_d*sum_d/static_cast<double>( count ) };
+}
+
+SampleStatistics merge_statistics( const SampleStatistics& a, const SampleStatistics& b ) {
+
+    double n_a = static_cast<double>( a.count );
+    double n_b = static_cast<double>( b.count );
+    double delta = b.sum/n_b - a.sum/n_a;
+
+    return SampleStatistics { a.count + b.count,
+                              a.sum + b.sum,
+                              a.sum_of_squares + b.sum_of_squares,
+                              a.squared_deviations + b.squared_deviations + delta*delta*n_a*n_b/( n_a + n_b ) };
+}
+
+template <typename T>
+SampleStatistics pairwise_statistics( const T* values, size_t count ) {
+
+    if( count <= statistics_block_points ) {
+        return block_statistics( values, count );
+    }
+
+    //split on a whole number of blocks, so every block but the last is full
+    size_t half = ( count/2 + statistics_block_points - 1 )/statistics_block_points*statistics_block_points;
+
+    return merge_statistics( pairwise_statistics( values, half ),
+                  pairwise_statistics( values + half, count - half ) );
+}
+
+template <typename T>
+SampleStatistics list_statistics( const T* values, size_t count ) {
+
+    if( count == 0 ) {
+        return SampleStatistics { 0, 0.0, 0.0, 0.0 };
+    }
+
+    return pairwise_statistics( values, count );
+}
+
+SampleStatistics statistics( const double* values, size_t count ) {
+    return list_statistics( values, count );
+}
+
+SampleStatistics statistics( const float* values, size_t count ) {
+    return list_statistics( values, count );
+}
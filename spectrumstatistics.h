@@ -0,0 +1,53 @@
+#ifndef SPECTRUMSTATISTICS_H
+#define SPECTRUMSTATISTICS_H
+
+// C System-Headers
+//
+// C++ System headers
+#include <cstddef>     //size_t
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+//
+
+/*! \file
+ * \brief Summary statistics of a list of values, shared by SingleSpectrum and the filters.
+ *
+ * Sum, sum of squares and variance are all found in a single SIMD pass. The list is split
+ * into short blocks, each block is summed around its own first value, and blocks are then
+ * merged pairwise (Chan et al.), so rounding errors grow with \f$ \log n \f$ rather than
+ * \f$ n \f$ and the variance does not suffer from the cancellation of
+ * \f$ \sum x^2 - n \bar{x}^2 \f$ when the mean is large compared to the spread.
+ */
+
+struct SampleStatistics {
+    size_t count;
+    double sum;
+    double sum_of_squares;
+    //sum of squared differences from the mean
+    double squared_deviations;
+
+    double mean() const;
+
+    /*!
+     * \brief Variance of the values, including Bessel's correction i.e. n/(n-1)
+     */
+    double variance() const;
+
+    double std_dev() const;
+
+    /*!
+     * \brief \f$ L_2 \f$ norm of the values = \f$ \sqrt{\sum_{i=1}^n | x_i |^2} \f$
+     */
+    double norm() const;
+};
+
+/*!
+ * \brief Compute the statistics of the first count values.
+ */
+SampleStatistics statistics( const double* values, size_t count );
+SampleStatistics statistics( const float* values, size_t count );
+
+#endif // SPECTRUMSTATISTICS_H
@@ -0,0 +1,53 @@
+// Header for this file
+#include "spectrumview.h"
+// C System-Headers
+//
+// C++ System headers
+//
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "singlespectrum.h"
+
+SpectrumView::SpectrumView( const SingleSpectrum& spectrum ) {
+
+    spectrum.Materialize();
+
+    num_points = spectrum.size();
+    power_list = spectrum.sa_power_list.data();
+
+    bool populated = ( spectrum.uncertainties.size() == spectrum.size() );
+    uncertainty_list = ( populated )? spectrum.uncertainties.data() : nullptr;
+
+    current_units = spectrum.current_units;
+    center_frequency = spectrum.center_frequency;
+    frequency_span = spectrum.frequency_span;
+}
+
+//Frequencies are computed exactly as SingleSpectrum computes them, so that both agree to the last bit
+
+double SpectrumView::min_freq() const {
+    return ( center_frequency - 0.5*frequency_span);
+}
+
+double SpectrumView::max_freq() const {
+    return ( center_frequency + 0.5*frequency_span);
+}
+
+double SpectrumView::bin_width() const {
+    return frequency_span/static_cast<double>( num_points );
+}
+
+double SpectrumView::bin_start_freq( uint idx ) const {
+    double freq_start = center_frequency - 0.5*frequency_span;
+    double dub_idx = static_cast<double>(idx);
+    double dub_size = static_cast<double>( num_points );
+
+    return freq_start+dub_idx*frequency_span/dub_size;
+}
+
+double SpectrumView::bin_mid_freq( uint idx ) const {
+    return bin_start_freq( idx )+0.5*bin_width();
+}
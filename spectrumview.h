@@ -0,0 +1,111 @@
+#ifndef SPECTRUMVIEW_H
+#define SPECTRUMVIEW_H
+
+// C System-Headers
+#include <sys/types.h> //uint
+// C++ System headers
+//
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "spectrum.h"
+#include "alignedallocator.h"
+
+class SingleSpectrum;
+
+/*!
+ * \brief Read-only, non-owning view of the power values, uncertainties and
+ * frequency grid of a SingleSpectrum.
+ *
+ * A view is two pointers and a handful of header values, so it may be passed around
+ * and copied freely without ever copying power values.
+ *
+ * A view does not keep its spectrum alive. It is valid until the spectrum is modified,
+ * spilled, evicted or destroyed.
+ */
+class SpectrumView {
+
+  public:
+    /*!
+     * \brief Decodes the power values of spectrum if need be, see SingleSpectrum::Materialize().
+     */
+    SpectrumView( const SingleSpectrum& spectrum );
+
+    /*!
+     * \brief Get the number of points in the spectrum.
+     */
+    uint size() const {
+        return num_points;
+    }
+
+    double power( uint idx ) const {
+        return power_list[idx];
+    }
+
+    /*!
+     * \brief Get the uncertainty of a point, or zero if uncertainties have not been populated.
+     */
+    double uncertainty( uint idx ) const {
+        return ( uncertainty_list != nullptr )? uncertainty_list[idx] : 0.0;
+    }
+
+    bool has_uncertainties() const {
+        return uncertainty_list != nullptr;
+    }
+
+    /*!
+     * \brief Get all size() power values.
+     */
+    const spectrum_value* power_data() const {
+        return power_list;
+    }
+
+    /*!
+     * \brief Get all size() uncertainties, or nullptr if they have not been populated.
+     */
+    const spectrum_value* uncertainty_data() const {
+        return uncertainty_list;
+    }
+
+    Units units() const {
+        return current_units;
+    }
+
+    /*!
+     * \brief See SingleSpectrum::min_freq()
+     */
+    double min_freq() const;
+
+    /*!
+     * \brief See SingleSpectrum::max_freq()
+     */
+    double max_freq() const;
+
+    /*!
+     * \brief See SingleSpectrum::bin_width()
+     */
+    double bin_width() const;
+
+    /*!
+     * \brief See SingleSpectrum::bin_start_freq()
+     */
+    double bin_start_freq( uint idx ) const;
+
+    /*!
+     * \brief See SingleSpectrum::bin_mid_freq()
+     */
+    double bin_mid_freq( uint idx ) const;
+
+  private:
+    const spectrum_value* power_list;
+    const spectrum_value* uncertainty_list;
+    uint num_points;
+
+    Units current_units;
+    double center_frequency; //MHz
+    double frequency_span; //MHz
+};
+
+#endif // SPECTRUMVIEW_H
@@ -0,0 +1,172 @@
+// Header for this file
+#include "spillfile.h"
+// C System-Headers
+#include <stdlib.h>    //mkstemp()
+#include <unistd.h>    //pwrite(), unlink(), close(), sysconf()
+#include <sys/mman.h>  //mmap(), madvise()
+#include <errno.h>     //errno
+#include <string.h>    //strerror(), memcpy()
+// C++ System headers
+#include <string>      //string
+#include <vector>      //vector
+#include <stdexcept>   //std::invalid_argument, std::runtime_error
+#include <iterator>    //std::prev
+#include <utility>     //std::move
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+//
+
+SpillFile::SpillFile( std::string dir_name ) {
+
+    std::string file_template = dir_name + "tigerlyzer_spill_XXXXXX";
+    std::vector<char> file_name( file_template.begin(), file_template.end() );
+    file_name.push_back( '\0' );
+
+    spill_fd = mkstemp( file_name.data() );
+
+    if( spill_fd < 0 ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nCould not create spill file in "+dir_name+" : ";
+        err_mesg += strerror( errno );
+        throw std::invalid_argument(err_mesg);
+    }
+
+    //the file stays usable through spill_fd, but disappears as soon as it is closed
+    unlink( file_name.data() );
+}
+
+SpillFile::~SpillFile() {
+    close( spill_fd );
+}
+
+SpillRegion::SpillRegion( std::shared_ptr<SpillFile> file, size_t num_values ) :
+    file( std::move( file ) ),
+    capacity( num_values ) {
+
+    offset = this->file->Allocate( num_values );
+}
+
+SpillRegion::~SpillRegion() {
+    file->Free( offset, capacity );
+}
+
+uint64_t SpillFile::Allocate( size_t num_values ) {
+
+    std::lock_guard<std::mutex> lock( guard );
+
+    uint64_t length = num_values*sizeof( spectrum_value );
+
+    for( auto region = free_regions.begin(); region != free_regions.end(); region++ ) {
+
+        if( region->second >= length ) {
+            uint64_t offset = region->first;
+            uint64_t remaining = region->second - length;
+
+            free_regions.erase( region );
+
+            if( remaining > 0 ) {
+                free_regions[offset + length] = remaining;
+            }
+
+            return offset;
+        }
+    }
+
+    uint64_t offset = file_end;
+    file_end += length;
+
+    return offset;
+}
+
+void SpillFile::Free( uint64_t offset, size_t num_values ) {
+
+    std::lock_guard<std::mutex> lock( guard );
+
+    uint64_t length = num_values*sizeof( spectrum_value );
+
+    if( length == 0 ) {
+        return;
+    }
+
+    //merge with the free regions either side
+    auto next = free_regions.lower_bound( offset );
+
+    if( next != free_regions.end() && next->first == offset + length ) {
+        length += next->second;
+        next = free_regions.erase( next );
+    }
+
+    if( next != free_regions.begin() ) {
+        auto previous = std::prev( next );
+
+        if( previous->first + previous->second == offset ) {
+            offset = previous->first;
+            length += previous->second;
+            free_regions.erase( previous );
+        }
+    }
+
+    //a region at the end of the file simply shortens it
+    if( offset + length == file_end ) {
+        file_end = offset;
+    } else {
+        free_regions[offset] = length;
+    }
+}
+
+void SpillFile::Write( uint64_t offset, const spectrum_value* values, size_t num_values ) {
+
+    const char* data = reinterpret_cast<const char*>( values );
+    size_t remaining = num_values*sizeof( spectrum_value );
+
+    while( remaining > 0 ) {
+
+        ssize_t written = pwrite( spill_fd, data, remaining, static_cast<off_t>( offset ) );
+
+        if( written < 0 && errno == EINTR ) {
+            continue;
+        }
+
+        if( written <= 0 ) {
+            std::string err_mesg = __FUNCTION__;
+            err_mesg += "\nCould not write to spill file: ";
+            err_mesg += strerror( errno );
+            throw std::runtime_error(err_mesg);
+        }
+
+        data += written;
+        offset += written;
+        remaining -= written;
+    }
+}
+
+void SpillFile::Read( uint64_t offset, spectrum_value* values, size_t num_values ) {
+
+    if( num_values == 0 ) {
+        return;
+    }
+
+    //mappings must start on a page boundary
+    static const uint64_t page_size = static_cast<uint64_t>( sysconf( _SC_PAGESIZE ) );
+
+    uint64_t map_start = offset - offset%page_size;
+    size_t lead = static_cast<size_t>( offset - map_start );
+    size_t map_length = lead + num_values*sizeof( spectrum_value );
+
+    void* mapped = mmap( nullptr, map_length, PROT_READ, MAP_PRIVATE, spill_fd, static_cast<off_t>( map_start ) );
+
+    if( mapped == MAP_FAILED ) {
+        std::string err_mesg = __FUNCTION__;
+        err_mesg += "\nCould not map spill file: ";
+        err_mesg += strerror( errno );
+        throw std::runtime_error(err_mesg);
+    }
+
+    madvise( mapped, map_length, MADV_SEQUENTIAL );
+    memcpy( values, static_cast<const char*>( mapped ) + lead, num_values*sizeof( spectrum_value ) );
+
+    munmap( mapped, map_length );
+}
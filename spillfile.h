@@ -0,0 +1,110 @@
+#ifndef SPILLFILE_H
+#define SPILLFILE_H
+
+// C System-Headers
+//
+// C++ System headers
+#include <string>      //string
+#include <memory>      //std::shared_ptr
+#include <mutex>       //std::mutex
+#include <map>         //std::map
+#include <cstdint>     //uint64_t
+#include <cstddef>     //size_t
+// Boost Headers
+//
+// Miscellaneous Headers
+//
+//Project Specific Headers
+#include "alignedallocator.h"
+
+/*!
+ * \brief Scratch file that holds power values and uncertainties of spectra
+ * that do not fit in memory.
+ *
+ * The file is created in the directory given and removed from that directory straight away,
+ * so it never outlives the program- even if the program crashes. Disk space is handed back
+ * once every SpillFile (and SpillRegion) referring to it has been destroyed.
+ *
+ * Regions that are no longer needed (see SpillRegion) are handed back with Free() and reused
+ * by later allocations, so the file only grows as large as the spectra spilled at any one time.
+ *
+ * Values are written with pwrite and read back through a temporary read-only memory map, so
+ * reading a spilled spectrum never goes through an intermediate buffer. Allocate, Write and
+ * Read may be called from several threads at once, as long as they touch different regions.
+ */
+class SpillFile {
+
+  public:
+    /*!
+     * \param dir_name
+     * Directory the spill file is created in, this should be on a disk with enough free space
+     * to hold every spectrum that will be spilled.
+     *
+     * \throws std::invalid_argument
+     * Thrown if the spill file could not be created.
+     */
+    SpillFile( std::string dir_name );
+    ~SpillFile();
+
+    SpillFile( const SpillFile& ) = delete;
+    SpillFile& operator=( const SpillFile& ) = delete;
+
+    /*!
+     * \brief Reserve room for num_values values, in the first freed region large enough
+     * or otherwise at the end of the file.
+     *
+     * \return
+     * Byte offset of the reserved region.
+     */
+    uint64_t Allocate( size_t num_values );
+
+    /*!
+     * \brief Hand back a region reserved by Allocate( num_values ), so it can be reused.
+     */
+    void Free( uint64_t offset, size_t num_values );
+
+    /*!
+     * \brief Write num_values values starting at a byte offset.
+     *
+     * \throws std::runtime_error
+     * Thrown if the values could not be written, e.g. the disk is full.
+     */
+    void Write( uint64_t offset, const spectrum_value* values, size_t num_values );
+
+    /*!
+     * \brief Read num_values values starting at a byte offset.
+     *
+     * \throws std::runtime_error
+     * Thrown if the region could not be mapped.
+     */
+    void Read( uint64_t offset, spectrum_value* values, size_t num_values );
+
+  private:
+    int spill_fd = -1;
+
+    std::mutex guard;
+    uint64_t file_end = 0;
+
+    //regions before file_end that are not in use, length (in bytes) by offset,
+    //neighbouring regions are always merged
+    std::map<uint64_t, uint64_t> free_regions;
+};
+
+/*!
+ * \brief Part of a SpillFile holding the values of a single spectrum.
+ *
+ * The region is reserved when it is created and handed back to its file when it is destroyed.
+ */
+struct SpillRegion {
+    std::shared_ptr<SpillFile> file;
+    uint64_t offset;   //in bytes
+    size_t capacity;   //in values
+
+    SpillRegion( std::shared_ptr<SpillFile> file, size_t num_values );
+    ~SpillRegion();
+
+    SpillRegion( const SpillRegion& ) = delete;
+    SpillRegion& operator=( const SpillRegion& ) = delete;
+};
+
+#endif // SPILLFILE_H